@@ -39,12 +39,26 @@
 #include <functional>
 #include <sstream>
 
+// The thread pool used by designs generated with `write_cxxrtl -threads <n>` is only available if
+// CXXRTL_THREADS is defined. Such designs define it before including this header, so that other designs
+// do not depend on the platform threading library.
+#ifdef CXXRTL_THREADS
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#endif
+
 #include <backends/cxxrtl/cxxrtl_capi.h>
 
 #ifndef __has_attribute
 #	define __has_attribute(x) 0
 #endif
 
+#ifndef __has_builtin
+#	define __has_builtin(x) 0
+#endif
+
 // CXXRTL essentially uses the C++ compiler as a hygienic macro engine that feeds an instruction selector.
 // It generates a lot of specialized template functions with relatively large bodies that, when inlined
 // into the caller and (for those with loops) unrolled, often expose many new optimization opportunities.
@@ -94,6 +108,19 @@ namespace cxxrtl {
 typedef uint32_t chunk_t;
 typedef uint64_t wide_chunk_t;
 
+// Although the chunk size is fixed, carry chains and multiplication are faster when performed on pairs of chunks,
+// i.e. on 64-bit limbs, if the platform provides a 128-bit integer type to hold the intermediate results.
+#ifndef CXXRTL_WIDE_LIMBS
+#if defined(__SIZEOF_INT128__)
+#define CXXRTL_WIDE_LIMBS 1
+#else
+#define CXXRTL_WIDE_LIMBS 0
+#endif
+#endif
+#if CXXRTL_WIDE_LIMBS
+typedef unsigned __int128 wide_limb_t;
+#endif
+
 template<typename T>
 struct chunk_traits {
 	static_assert(std::is_integral<T>::value && std::is_unsigned<T>::value,
@@ -418,6 +445,7 @@ struct value : public expr_base<value<Bits>> {
 			carry = (shift_bits == 0) ? 0
 				: data[n] >> (chunk::bits - shift_bits);
 		}
+		result.data[result.chunks - 1] &= result.msb_mask;
 		return result;
 	}
 
@@ -428,12 +456,12 @@ struct value : public expr_base<value<Bits>> {
 		// Detect shifts definitely large than Bits early.
 		for (size_t n = 1; n < amount.chunks; n++)
 			if (amount.data[n] != 0)
-				return {};
+				return (Signed && is_neg()) ? value<Bits>().bit_not() : value<Bits>();
 		// Past this point we can use the least significant chunk as the shift size.
 		size_t shift_chunks = amount.data[0] / chunk::bits;
 		size_t shift_bits   = amount.data[0] % chunk::bits;
 		if (shift_chunks >= chunks)
-			return {};
+			return (Signed && is_neg()) ? value<Bits>().bit_not() : value<Bits>();
 		value<Bits> result;
 		chunk::type carry = 0;
 		for (size_t n = 0; n < chunks - shift_chunks; n++) {
@@ -442,12 +470,13 @@ struct value : public expr_base<value<Bits>> {
 				: data[chunks - 1 - n] << (chunk::bits - shift_bits);
 		}
 		if (Signed && is_neg()) {
-			size_t top_chunk_idx  = (Bits - shift_bits) / chunk::bits;
-			size_t top_chunk_bits = (Bits - shift_bits) % chunk::bits;
+			size_t top_chunk_idx  = amount.data[0] > Bits ? 0 : (Bits - amount.data[0]) / chunk::bits;
+			size_t top_chunk_bits = amount.data[0] > Bits ? 0 : (Bits - amount.data[0]) % chunk::bits;
 			for (size_t n = top_chunk_idx + 1; n < chunks; n++)
 				result.data[n] = chunk::mask;
-			if (shift_bits != 0)
+			if (amount.data[0] != 0)
 				result.data[top_chunk_idx] |= chunk::mask << top_chunk_bits;
+			result.data[chunks - 1] &= msb_mask;
 		}
 		return result;
 	}
@@ -460,9 +489,13 @@ struct value : public expr_base<value<Bits>> {
 	size_t ctpop() const {
 		size_t count = 0;
 		for (size_t n = 0; n < chunks; n++) {
+#if __has_builtin(__builtin_popcount)
+			count += __builtin_popcount(data[n]);
+#else
 			// This loop implements the population count idiom as recognized by LLVM and GCC.
 			for (chunk::type x = data[n]; x != 0; count++)
 				x = x & (x - 1);
+#endif
 		}
 		return count;
 	}
@@ -474,26 +507,70 @@ struct value : public expr_base<value<Bits>> {
 			if (x == 0) {
 				count += (n == 0 ? Bits % chunk::bits : chunk::bits);
 			} else {
+#if __has_builtin(__builtin_clz)
+				static_assert(sizeof(chunk::type) == sizeof(unsigned), "__builtin_clz() requires 32-bit chunks");
+				count += chunk::bits - __builtin_clz(x);
+#else
 				// This loop implements the find first set idiom as recognized by LLVM.
 				for (; x != 0; count++)
 					x >>= 1;
+#endif
 			}
 		}
 		return count;
 	}
 
+#if CXXRTL_WIDE_LIMBS
+	// Values are stored as chunks, but may be viewed as an array of 64-bit limbs with the last limb possibly
+	// being half-filled. The compiler combines the two chunk accesses into one limb access where possible.
+	static constexpr size_t limbs = (chunks + 1) / 2;
+
+	CXXRTL_ALWAYS_INLINE
+	uint64_t limb(size_t n) const {
+		uint64_t result = data[2 * n];
+		if (2 * n + 1 < chunks)
+			result |= uint64_t(data[2 * n + 1]) << chunk::bits;
+		return result;
+	}
+
+	CXXRTL_ALWAYS_INLINE
+	void set_limb(size_t n, uint64_t limb) {
+		data[2 * n] = limb;
+		if (2 * n + 1 < chunks)
+			data[2 * n + 1] = limb >> chunk::bits;
+	}
+#endif
+
 	template<bool Invert, bool CarryIn>
 	std::pair<value<Bits>, bool /*CarryOut*/> alu(const value<Bits> &other) const {
 		value<Bits> result;
-		bool carry = CarryIn;
-		for (size_t n = 0; n < result.chunks; n++) {
-			result.data[n] = data[n] + (Invert ? ~other.data[n] : other.data[n]) + carry;
-			if (result.chunks - 1 == n)
-				result.data[result.chunks - 1] &= result.msb_mask;
-			carry = (result.data[n] <  data[n]) ||
-			        (result.data[n] == data[n] && carry);
+		// The carry out is taken from bit `Bits`, so the operands are limited to `Bits` bits, including
+		// the inverted one; the carry out of the most significant chunk (or limb) is then at `top_bits`.
+#if CXXRTL_WIDE_LIMBS
+		constexpr size_t top_bits = Bits - (limbs - 1) * 64;
+		constexpr uint64_t top_mask = (top_bits == 64) ? ~uint64_t(0) : ~(~uint64_t(0) << top_bits);
+		wide_limb_t carry = CarryIn;
+		for (size_t n = 0; n < limbs; n++) {
+			uint64_t operand = Invert ? ~other.limb(n) : other.limb(n);
+			if (n == limbs - 1)
+				operand &= top_mask;
+			wide_limb_t sum = wide_limb_t(limb(n)) + operand + carry;
+			result.set_limb(n, uint64_t(sum) & (n == limbs - 1 ? top_mask : ~uint64_t(0)));
+			carry = sum >> (n == limbs - 1 ? top_bits : 64);
+		}
+#else
+		constexpr size_t top_bits = Bits - (chunks - 1) * chunk::bits;
+		wide_chunk_t carry = CarryIn;
+		for (size_t n = 0; n < chunks; n++) {
+			chunk::type operand = Invert ? ~other.data[n] : other.data[n];
+			if (n == chunks - 1)
+				operand &= msb_mask;
+			wide_chunk_t sum = wide_chunk_t(data[n]) + operand + carry;
+			result.data[n] = sum & (n == chunks - 1 ? msb_mask : chunk::mask);
+			carry = sum >> (n == chunks - 1 ? top_bits : chunk::bits);
 		}
-		return {result, carry};
+#endif
+		return {result, bool(carry)};
 	}
 
 	value<Bits> add(const value<Bits> &other) const {
@@ -525,17 +602,31 @@ struct value : public expr_base<value<Bits>> {
 	template<size_t ResultBits>
 	value<ResultBits> mul(const value<Bits> &other) const {
 		value<ResultBits> result;
-		wide_chunk_t wide_result[result.chunks + 1] = {};
-		for (size_t n = 0; n < chunks; n++) {
-			for (size_t m = 0; m < chunks && n + m < result.chunks; m++) {
-				wide_result[n + m] += wide_chunk_t(data[n]) * wide_chunk_t(other.data[m]);
-				wide_result[n + m + 1] += wide_result[n + m] >> chunk::bits;
-				wide_result[n + m] &= chunk::mask;
+		// Schoolbook multiplication, one row of partial products at a time, with the carry kept in a register.
+#if CXXRTL_WIDE_LIMBS
+		for (size_t n = 0; n < limbs && 2 * n < result.chunks; n++) {
+			wide_limb_t carry = 0;
+			uint64_t multiplicand = limb(n);
+			for (size_t m = 0; m < limbs && 2 * (n + m) < result.chunks; m++) {
+				wide_limb_t product = wide_limb_t(multiplicand) * other.limb(m) + result.limb(n + m) + carry;
+				result.set_limb(n + m, uint64_t(product));
+				carry = product >> 64;
 			}
+			if (2 * (n + limbs) < result.chunks)
+				result.set_limb(n + limbs, uint64_t(carry));
 		}
-		for (size_t n = 0; n < result.chunks; n++) {
-			result.data[n] = wide_result[n];
+#else
+		for (size_t n = 0; n < chunks && n < result.chunks; n++) {
+			wide_chunk_t carry = 0;
+			for (size_t m = 0; m < chunks && n + m < result.chunks; m++) {
+				wide_chunk_t product = wide_chunk_t(data[n]) * other.data[m] + result.data[n + m] + carry;
+				result.data[n + m] = product;
+				carry = product >> chunk::bits;
+			}
+			if (n + chunks < result.chunks)
+				result.data[n + chunks] = carry;
 		}
+#endif
 		result.data[result.chunks - 1] &= result.msb_mask;
 		return result;
 	}
@@ -811,6 +902,144 @@ struct memory {
 	}
 };
 
+// A memory that is allocated on demand in fixed size pages, for memories whose depth makes a dense array impractical,
+// e.g. a DRAM model covering the whole address space. Unallocated pages read as zero, and a page is allocated only
+// when a word in it is written. The interface is the same as that of `memory<Width>`, except that direct memory
+// writes use `store()` (since a writable reference would require allocating a page on every read), and that
+// the contents are not contiguous and so cannot be exposed through the debug interface.
+template<size_t Width>
+struct sparse_memory {
+	static constexpr size_t page_depth = 4096;
+
+	size_t words;
+	// Every page is either unallocated (null), owned by this memory, or adopted from an external buffer.
+	std::vector<value<Width>*> pages;
+	std::vector<std::unique_ptr<value<Width>[]>> owned_pages;
+
+	size_t depth() const {
+		return words;
+	}
+
+	size_t allocated_pages() const {
+		size_t count = 0;
+		for (auto page : pages)
+			if (page != nullptr)
+				count++;
+		return count;
+	}
+
+	sparse_memory() = delete;
+	explicit sparse_memory(size_t depth) : words(depth), pages((depth + page_depth - 1) / page_depth) {}
+
+	sparse_memory(const sparse_memory<Width> &) = delete;
+	sparse_memory<Width> &operator=(const sparse_memory<Width> &) = delete;
+
+	sparse_memory(sparse_memory<Width> &&) = default;
+	sparse_memory<Width> &operator=(sparse_memory<Width> &&) = default;
+
+	template<size_t Size>
+	struct init {
+		size_t offset;
+		value<Width> data[Size];
+	};
+
+	template<size_t... InitSize>
+	explicit sparse_memory(size_t depth, const init<InitSize> &...init) : sparse_memory(depth) {
+		auto _ = {(load(init.data, InitSize, init.offset), 0)...};
+		(void)_;
+	}
+
+	// An operator for direct memory reads. May be used at any time during the simulation.
+	const value<Width> &operator [](size_t index) const {
+		static const value<Width> zero;
+		assert(index < words);
+		const value<Width> *page = pages[index / page_depth];
+		return page ? page[index % page_depth] : zero;
+	}
+
+	// A function for direct memory writes. May only be used before the simulation is started. If used
+	// after the simulation is started, the design may malfunction.
+	void store(size_t index, const value<Width> &val) {
+		slot(index) = val;
+	}
+
+	// Copy `count` words starting at `index`. Pages that are entirely zero in the source are not allocated.
+	void load(const value<Width> *data, size_t count, size_t index = 0) {
+		static const value<Width> zero;
+		assert(index + count <= words);
+		for (size_t n = 0; n < count; n++)
+			if (pages[(index + n) / page_depth] != nullptr || data[n] != zero)
+				slot(index + n) = data[n];
+	}
+
+	// Use `count` words starting at `data`, which must remain valid while this memory exists, as the backing storage
+	// for the words starting at `index`. Whole pages that are covered by the buffer are used without copying; this
+	// makes it possible to e.g. map a file with `MAP_PRIVATE` and use it as the initial contents of the memory.
+	void adopt(value<Width> *data, size_t count, size_t index = 0) {
+		assert(index + count <= words);
+		size_t n = 0;
+		while (n < count) {
+			size_t page_index = (index + n) / page_depth;
+			size_t page_offset = (index + n) % page_depth;
+			size_t page_words = words - page_index * page_depth;
+			if (page_words > page_depth)
+				page_words = page_depth;
+			if (page_offset == 0 && count - n >= page_words && pages[page_index] == nullptr) {
+				pages[page_index] = data + n;
+				n += page_words;
+			} else {
+				size_t chunk_words = std::min(page_words - page_offset, count - n);
+				for (size_t m = 0; m < chunk_words; m++)
+					slot(index + n + m) = data[n + m];
+				n += chunk_words;
+			}
+		}
+	}
+
+	// See the comment in `memory<Width>` for the rationale behind the write queue.
+	struct write {
+		size_t index;
+		value<Width> val;
+		value<Width> mask;
+		int priority;
+	};
+	std::vector<write> write_queue;
+
+	void update(size_t index, const value<Width> &val, const value<Width> &mask, int priority = 0) {
+		assert(index < words);
+		// Queue up the write while keeping the queue sorted by priority.
+		write_queue.insert(
+			std::upper_bound(write_queue.begin(), write_queue.end(), priority,
+				[](const int a, const write& b) { return a < b.priority; }),
+			write { index, val, mask, priority });
+	}
+
+	bool commit() {
+		bool changed = false;
+		for (const write &entry : write_queue) {
+			value<Width> elem = (*this)[entry.index];
+			elem = elem.update(entry.val, entry.mask);
+			if ((*this)[entry.index] != elem) {
+				slot(entry.index) = elem;
+				changed = true;
+			}
+		}
+		write_queue.clear();
+		return changed;
+	}
+
+private:
+	value<Width> &slot(size_t index) {
+		assert(index < words);
+		value<Width> *&page = pages[index / page_depth];
+		if (page == nullptr) {
+			owned_pages.emplace_back(new value<Width>[page_depth]);
+			page = owned_pages.back().get();
+		}
+		return page[index % page_depth];
+	}
+};
+
 struct metadata {
 	const enum {
 		MISSING = 0,
@@ -1035,6 +1264,121 @@ struct debug_items {
 	}
 };
 
+#ifdef CXXRTL_THREADS
+// Designs generated with `write_cxxrtl -threads <n>` split their eval() into independent partitions, i.e. sets
+// of flow graph nodes that share no wires, memories, or cells with each other, and evaluate those partitions
+// using this fork-join thread pool. Every call to `run()` is a barrier: it returns only after all partitions
+// have been evaluated, so the commit phase and the next delta cycle always observe a consistent state.
+//
+// The calling thread participates in the evaluation, so a pool with no workers simply evaluates partitions
+// sequentially. The shared pool starts with no workers; a driver opts into multithreaded evaluation with e.g.:
+//
+//   cxxrtl::thread_pool::shared().resize(std::thread::hardware_concurrency() - 1);
+class thread_pool {
+	struct job {
+		const std::function<void(size_t)> &task;
+		size_t count;
+		std::atomic<size_t> next_index;
+
+		job(const std::function<void(size_t)> &task, size_t count) : task(task), count(count), next_index(0) {}
+
+		void drain() {
+			size_t index;
+			while ((index = next_index.fetch_add(1, std::memory_order_relaxed)) < count)
+				task(index);
+		}
+	};
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable work_cond, done_cond;
+	job *current_job = nullptr;
+	uint64_t generation = 0;
+	size_t active_workers = 0;
+	bool stopping = false;
+
+	void worker_loop() {
+		uint64_t seen_generation = 0;
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			work_cond.wait(lock, [&] { return stopping || (current_job && generation != seen_generation); });
+			if (stopping)
+				return;
+			seen_generation = generation;
+			job *claimed_job = current_job;
+			active_workers++;
+			lock.unlock();
+			claimed_job->drain();
+			lock.lock();
+			if (--active_workers == 0)
+				done_cond.notify_all();
+		}
+	}
+
+	void stop() {
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			stopping = true;
+		}
+		work_cond.notify_all();
+		for (auto &worker : workers)
+			worker.join();
+		workers.clear();
+		stopping = false;
+	}
+
+public:
+	explicit thread_pool(size_t worker_count = 0) {
+		resize(worker_count);
+	}
+
+	~thread_pool() {
+		stop();
+	}
+
+	thread_pool(const thread_pool &) = delete;
+	thread_pool &operator=(const thread_pool &) = delete;
+
+	size_t size() const {
+		return workers.size();
+	}
+
+	// May not be called while `run()` is in progress.
+	void resize(size_t worker_count) {
+		stop();
+		for (size_t n = 0; n < worker_count; n++)
+			workers.emplace_back(&thread_pool::worker_loop, this);
+	}
+
+	// Call `task(0)`, ..., `task(count - 1)`, possibly concurrently, and wait until all of them return.
+	void run(size_t count, const std::function<void(size_t)> &task) {
+		if (workers.empty() || count < 2) {
+			for (size_t index = 0; index < count; index++)
+				task(index);
+			return;
+		}
+
+		job this_job(task, count);
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			current_job = &this_job;
+			generation++;
+		}
+		work_cond.notify_all();
+		this_job.drain();
+
+		std::unique_lock<std::mutex> lock(mutex);
+		current_job = nullptr;
+		done_cond.wait(lock, [&] { return active_workers == 0; });
+	}
+
+	static thread_pool &shared() {
+		static thread_pool pool;
+		return pool;
+	}
+};
+#endif // CXXRTL_THREADS
+
 // Tag class to disambiguate module move constructor and module constructor that takes black boxes
 // out of another instance of the module.
 struct adopt {};
@@ -632,16 +632,29 @@ struct CxxrtlWorker {
 	bool debug_alias = false;
 	bool debug_eval = false;
 
+	int max_partitions = 1;
+	bool track_activity = false;
+	int sparse_depth = 0;
+
 	std::ostringstream f;
 	std::string indent;
 	int temporary = 0;
 
+	// A subset of the eval() schedule that shares no state with the rest of it.
+	struct EvalComponent {
+		std::vector<FlowGraph::Node> nodes;
+		std::vector<const RTLIL::Wire*> inputs, edge_wires;
+		bool always_active = false;
+		int partition = 0;
+	};
+
 	dict<const RTLIL::Module*, SigMap> sigmaps;
 	pool<const RTLIL::Wire*> edge_wires;
 	dict<RTLIL::SigBit, RTLIL::SyncType> edge_types;
 	pool<const RTLIL::Memory*> writable_memories;
 	dict<const RTLIL::Cell*, pool<const RTLIL::Cell*>> transparent_for;
 	dict<const RTLIL::Module*, std::vector<FlowGraph::Node>> schedule, debug_schedule;
+	dict<const RTLIL::Module*, std::vector<EvalComponent>> eval_components;
 	dict<const RTLIL::Wire*, WireType> wire_types, debug_wire_types;
 	dict<RTLIL::SigBit, bool> bit_has_state;
 	dict<const RTLIL::Module*, pool<std::string>> blackbox_specializations;
@@ -1650,6 +1663,13 @@ struct CxxrtlWorker {
 		f << "value<" << wire->width << "> " << mangle(wire) << ";\n";
 	}
 
+	bool is_sparse_memory(const RTLIL::Memory *memory)
+	{
+		if (memory->has_attribute(ID(cxxrtl_sparse)))
+			return memory->get_bool_attribute(ID(cxxrtl_sparse));
+		return sparse_depth > 0 && memory->size >= sparse_depth;
+	}
+
 	void dump_memory(RTLIL::Module *module, const RTLIL::Memory *memory)
 	{
 		vector<const RTLIL::Cell*> init_cells;
@@ -1663,8 +1683,9 @@ struct CxxrtlWorker {
 			return a_prio > b_prio || (a_prio == b_prio && a_addr < b_addr);
 		});
 
+		const char *memory_type = is_sparse_memory(memory) ? "sparse_memory" : "memory";
 		dump_attrs(memory);
-		f << indent << "memory<" << memory->width << "> " << mangle(memory)
+		f << indent << memory_type << "<" << memory->width << "> " << mangle(memory)
 		            << " { " << memory->size << "u";
 		if (init_cells.empty()) {
 			f << " };\n";
@@ -1676,7 +1697,7 @@ struct CxxrtlWorker {
 					RTLIL::Const data = cell->getPort(ID::DATA).as_const();
 					size_t width = cell->getParam(ID::WIDTH).as_int();
 					size_t words = cell->getParam(ID::WORDS).as_int();
-					f << indent << "memory<" << memory->width << ">::init<" << words << "> { "
+					f << indent << memory_type << "<" << memory->width << ">::init<" << words << "> { "
 					            << stringf("%#x", cell->getPort(ID::ADDR).as_int()) << ", {";
 					inc_indent();
 						for (size_t n = 0; n < words; n++) {
@@ -1695,6 +1716,67 @@ struct CxxrtlWorker {
 		}
 	}
 
+	void dump_node(const FlowGraph::Node &node)
+	{
+		switch (node.type) {
+			case FlowGraph::Node::Type::CONNECT:
+				dump_connect(node.connect);
+				break;
+			case FlowGraph::Node::Type::CELL_SYNC:
+				dump_cell_sync(node.cell);
+				break;
+			case FlowGraph::Node::Type::CELL_EVAL:
+				dump_cell_eval(node.cell);
+				break;
+			case FlowGraph::Node::Type::PROCESS_CASE:
+				dump_process_case(node.process);
+				break;
+			case FlowGraph::Node::Type::PROCESS_SYNC:
+				dump_process_syncs(node.process);
+				break;
+		}
+	}
+
+	bool is_activity_tracked(const EvalComponent &component)
+	{
+		return track_activity && !component.always_active;
+	}
+
+	void dump_eval_component(int index, const EvalComponent &component)
+	{
+		if (!is_activity_tracked(component)) {
+			for (auto &node : component.nodes)
+				dump_node(node);
+			return;
+		}
+
+		std::string prefix = "activity_" + std::to_string(index) + "_";
+		f << indent << "if (!" << prefix << "valid";
+		for (auto wire : component.edge_wires)
+			for (auto edge_type : edge_types)
+				if (edge_type.first.wire == wire) {
+					if (edge_type.second != RTLIL::STn)
+						f << " || posedge_" << mangle(edge_type.first);
+					if (edge_type.second != RTLIL::STp)
+						f << " || negedge_" << mangle(edge_type.first);
+				}
+		for (auto wire : component.inputs) {
+			f << " ||\n" << indent << "    " << mangle(wire) << (wire_types[wire].is_buffered() ? ".curr" : "");
+			f << " != " << prefix << mangle(wire);
+		}
+		f << ") {\n";
+		inc_indent();
+			f << indent << prefix << "valid = true;\n";
+			for (auto wire : component.inputs) {
+				f << indent << prefix << mangle(wire) << " = " << mangle(wire);
+				f << (wire_types[wire].is_buffered() ? ".curr" : "") << ";\n";
+			}
+			for (auto &node : component.nodes)
+				dump_node(node);
+		dec_indent();
+		f << indent << "}\n";
+	}
+
 	void dump_eval_method(RTLIL::Module *module)
 	{
 		inc_indent();
@@ -1718,24 +1800,43 @@ struct CxxrtlWorker {
 				}
 				for (auto wire : module->wires())
 					dump_wire(wire, /*is_local=*/true);
-				for (auto node : schedule[module]) {
-					switch (node.type) {
-						case FlowGraph::Node::Type::CONNECT:
-							dump_connect(node.connect);
-							break;
-						case FlowGraph::Node::Type::CELL_SYNC:
-							dump_cell_sync(node.cell);
-							break;
-						case FlowGraph::Node::Type::CELL_EVAL:
-							dump_cell_eval(node.cell);
-							break;
-						case FlowGraph::Node::Type::PROCESS_CASE:
-							dump_process_case(node.process);
-							break;
-						case FlowGraph::Node::Type::PROCESS_SYNC:
-							dump_process_syncs(node.process);
-							break;
+				if (eval_components.count(module)) {
+					const std::vector<EvalComponent> &components = eval_components[module];
+					int partition_count = 1;
+					for (auto &component : components)
+						partition_count = std::max(partition_count, component.partition + 1);
+					if (partition_count > 1) {
+						// Each partition tracks convergence separately to avoid a data race on `converged`.
+						f << indent << "bool partition_converged[" << partition_count << "] = {";
+						for (int partition = 0; partition < partition_count; partition++)
+							f << (partition > 0 ? ", " : " ") << "true";
+						f << " };\n";
+						f << indent << "thread_pool::shared().run(" << partition_count << ", [&](size_t partition) {\n";
+						inc_indent();
+							f << indent << "bool &converged = partition_converged[partition];\n";
+							f << indent << "switch (partition) {\n";
+							for (int partition = 0; partition < partition_count; partition++) {
+								f << indent << "case " << partition << ": {\n";
+								inc_indent();
+									for (int index = 0; index < GetSize(components); index++)
+										if (components[index].partition == partition)
+											dump_eval_component(index, components[index]);
+									f << indent << "break;\n";
+								dec_indent();
+								f << indent << "}\n";
+							}
+							f << indent << "}\n";
+						dec_indent();
+						f << indent << "});\n";
+						f << indent << "for (bool converged_in_partition : partition_converged)\n";
+						f << indent << "\tconverged = converged && converged_in_partition;\n";
+					} else {
+						for (int index = 0; index < GetSize(components); index++)
+							dump_eval_component(index, components[index]);
 					}
+				} else {
+					for (auto node : schedule[module])
+						dump_node(node);
 				}
 			}
 			f << indent << "return converged;\n";
@@ -1931,6 +2032,9 @@ struct CxxrtlWorker {
 				for (auto &memory_it : module->memories) {
 					if (!memory_it.first.isPublic())
 						continue;
+					// Sparse memories are not contiguous and cannot be described by a debug item.
+					if (is_sparse_memory(memory_it.second))
+						continue;
 					f << indent << "items.add(path + " << escape_cxx_string(get_hdl_name(memory_it.second));
 					f << ", debug_item(" << mangle(memory_it.second) << ", ";
 					f << memory_it.second->start_offset << "));\n";
@@ -2076,6 +2180,21 @@ struct CxxrtlWorker {
 				}
 				if (has_cells)
 					f << "\n";
+				bool has_activity = false;
+				if (eval_components.count(module)) {
+					const std::vector<EvalComponent> &components = eval_components[module];
+					for (int index = 0; index < GetSize(components); index++) {
+						if (!is_activity_tracked(components[index]))
+							continue;
+						std::string prefix = "activity_" + std::to_string(index) + "_";
+						f << indent << "bool " << prefix << "valid = false;\n";
+						for (auto wire : components[index].inputs)
+							f << indent << "value<" << wire->width << "> " << prefix << mangle(wire) << ";\n";
+						has_activity = true;
+					}
+				}
+				if (has_activity)
+					f << "\n";
 				f << indent << mangle(module) << "() {}\n";
 				if (has_cells) {
 					f << indent << mangle(module) << "(adopt, " << mangle(module) << " other) :\n";
@@ -2165,6 +2284,20 @@ struct CxxrtlWorker {
 		}
 	}
 
+	void dump_threads_define()
+	{
+		if (max_partitions > 1) {
+			// The thread pool is not declared if the runtime has already been included without the define.
+			f << "#if defined(CXXRTL_H) && !defined(CXXRTL_THREADS)\n";
+			f << "#error \"Designs generated with `write_cxxrtl -threads` require CXXRTL_THREADS to be defined "
+			     "before the first inclusion of <backends/cxxrtl/cxxrtl.h>.\"\n";
+			f << "#endif\n";
+			f << "#ifndef CXXRTL_THREADS\n";
+			f << "#define CXXRTL_THREADS\n";
+			f << "#endif\n";
+		}
+	}
+
 	void dump_design(RTLIL::Design *design)
 	{
 		RTLIL::Module *top_module = nullptr;
@@ -2220,6 +2353,7 @@ struct CxxrtlWorker {
 			}
 			f << "#ifdef __cplusplus\n";
 			f << "\n";
+			dump_threads_define();
 			f << "#include <backends/cxxrtl/cxxrtl.h>\n";
 			f << "\n";
 			f << "using namespace cxxrtl;\n";
@@ -2236,10 +2370,12 @@ struct CxxrtlWorker {
 			*intf_f << f.str(); f.str("");
 		}
 
-		if (split_intf)
+		if (split_intf) {
 			f << "#include \"" << intf_filename << "\"\n";
-		else
+		} else {
+			dump_threads_define();
 			f << "#include <backends/cxxrtl/cxxrtl.h>\n";
+		}
 		f << "\n";
 		f << "#if defined(CXXRTL_INCLUDE_CAPI_IMPL) || \\\n";
 		f << "    defined(CXXRTL_INCLUDE_VCD_CAPI_IMPL)\n";
@@ -2572,6 +2708,141 @@ struct CxxrtlWorker {
 				if (live_nodes[node])
 					schedule[module].push_back(*node);
 
+			// Split eval() into components that can be evaluated independently. Two nodes must be evaluated in the same
+			// component if one of them uses a wire with a comb def in the other one (even if the latter node is not
+			// reachable, since a dead node may still be inlined into a live one), if both of them define the same wire,
+			// if they refer to the same memory (whose write queue is not thread-safe), or if they refer to the same cell
+			// or process (which are split into several nodes that share state). Wires that are only read during eval(),
+			// such as clocks, inputs, and flip-flop outputs, do not join components together.
+			if (max_partitions > 1 || track_activity) {
+				mfp<FlowGraph::Node*, hash_ptr_ops> components;
+				dict<const RTLIL::Wire*, FlowGraph::Node*> wire_def_nodes;
+				dict<RTLIL::IdString, FlowGraph::Node*> memory_nodes;
+				dict<const void*, FlowGraph::Node*, hash_ptr_ops> object_nodes;
+				auto merge_with = [&](FlowGraph::Node *node, FlowGraph::Node *&first_node) {
+					if (first_node == nullptr)
+						first_node = node;
+					else
+						components.merge(first_node, node);
+				};
+				for (auto node : flow.nodes) {
+					components(node);
+					for (auto node_defs : {&flow.node_comb_defs, &flow.node_sync_defs})
+						if (node_defs->count(node))
+							for (auto wire : node_defs->at(node))
+								merge_with(node, wire_def_nodes[wire]);
+					if (flow.node_uses.count(node))
+						for (auto wire : flow.node_uses.at(node))
+							if (flow.wire_comb_defs.count(wire))
+								for (auto def_node : flow.wire_comb_defs.at(wire))
+									components.merge(node, def_node);
+					if (node->cell != nullptr) {
+						merge_with(node, object_nodes[node->cell]);
+						if (node->cell->type.in(ID($memrd), ID($memwr)))
+							merge_with(node, memory_nodes[node->cell->getParam(ID::MEMID).decode_string()]);
+					}
+					if (node->process != nullptr)
+						merge_with(node, object_nodes[node->process]);
+				}
+
+				std::vector<EvalComponent> &module_components = eval_components[module];
+				dict<FlowGraph::Node*, int, hash_ptr_ops> component_indices;
+				for (auto node : node_order) {
+					if (!live_nodes[node])
+						continue;
+					FlowGraph::Node *root = components.find(node);
+					if (!component_indices.count(root)) {
+						component_indices[root] = GetSize(module_components);
+						module_components.emplace_back();
+					}
+					module_components[component_indices[root]].nodes.push_back(*node);
+				}
+
+				if (track_activity) {
+					// A component only needs to be evaluated if any of the member wires it reads (other than the wires
+					// it computes itself) changed since it was last evaluated, or if any of the clock edges it uses is
+					// active. Components that read writable memories or instantiate other modules have hidden state and
+					// are always evaluated.
+					dict<int, pool<const RTLIL::Wire*>> component_uses, component_comb_defs, component_edges;
+					for (auto node : flow.nodes) {
+						FlowGraph::Node *root = components.find(node);
+						if (!component_indices.count(root))
+							continue;
+						int index = component_indices[root];
+						bool is_live_or_inlined = live_nodes[node];
+						if (flow.node_comb_defs.count(node))
+							for (auto wire : flow.node_comb_defs.at(node)) {
+								component_comb_defs[index].insert(wire);
+								if (wire_types[wire].type == WireType::INLINE)
+									is_live_or_inlined = true;
+							}
+						if (is_live_or_inlined && flow.node_uses.count(node))
+							for (auto wire : flow.node_uses.at(node))
+								component_uses[index].insert(wire);
+						if (node->type == FlowGraph::Node::Type::CELL_EVAL) {
+							if (node->cell->type.isPublic())
+								module_components[index].always_active = true;
+							if (node->cell->type == ID($memrd) &&
+							    writable_memories[module->memories[node->cell->getParam(ID::MEMID).decode_string()]])
+								module_components[index].always_active = true;
+							// Clock edges are registered for the canonical clock bit, which may be on a different wire
+							// than the one connected to the clock port.
+							if (node->cell->hasPort(ID::CLK))
+								for (auto bit : sigmap(node->cell->getPort(ID::CLK)))
+									if (bit.wire)
+										component_edges[index].insert(bit.wire);
+						}
+						// The sync trigger of a process is not a use of its sync rules, but the process has to run on
+						// every edge of it.
+						if (node->type == FlowGraph::Node::Type::PROCESS_SYNC)
+							for (auto sync : node->process->syncs)
+								if (sync->type == RTLIL::STp || sync->type == RTLIL::STn || sync->type == RTLIL::STe)
+									for (auto bit : sigmap(sync->signal))
+										if (bit.wire)
+											component_edges[index].insert(bit.wire);
+					}
+					for (int index = 0; index < GetSize(module_components); index++) {
+						EvalComponent &component = module_components[index];
+						for (auto wire : module->wires()) {
+							if (edge_wires[wire] && (component_uses[index].count(wire) || component_edges[index].count(wire)))
+								component.edge_wires.push_back(wire);
+							if (!component_uses[index].count(wire))
+								continue;
+							const WireType &wire_type = wire_types[wire];
+							if (!wire_type.is_member())
+								continue;
+							if (!wire_type.is_buffered() && component_comb_defs[index].count(wire))
+								continue;
+							component.inputs.push_back(wire);
+						}
+					}
+				}
+
+				// Pack components into at most `max_partitions` partitions of roughly equal size.
+				std::vector<int> sorted_indices;
+				for (int index = 0; index < GetSize(module_components); index++)
+					sorted_indices.push_back(index);
+				std::stable_sort(sorted_indices.begin(), sorted_indices.end(), [&](int a, int b) {
+					return module_components[a].nodes.size() > module_components[b].nodes.size();
+				});
+				int partition_count = std::max(1, std::min<int>(max_partitions, GetSize(module_components)));
+				std::vector<int> partition_sizes(partition_count);
+				for (int index : sorted_indices) {
+					int partition = std::min_element(partition_sizes.begin(), partition_sizes.end()) - partition_sizes.begin();
+					partition_sizes[partition] += GetSize(module_components[index].nodes);
+					module_components[index].partition = partition;
+				}
+
+				log("Module `%s' is evaluated in %d independent components", log_id(module), GetSize(module_components));
+				if (partition_count > 1) {
+					log(" grouped into %d partitions of", partition_count);
+					for (int partition_size : partition_sizes)
+						log(" %d", partition_size);
+					log(" nodes");
+				}
+				log(".\n");
+			}
+
 			// For maximum performance, the state of the simulation (which is the same as the set of its double buffered
 			// wires, since using a singly buffered wire for any kind of state introduces a race condition) should contain
 			// no wires attached to combinatorial outputs. Feedback wires, by definition, make that impossible. However,
@@ -2977,6 +3248,12 @@ struct CxxrtlBackend : public Backend {
 		log("        if neither is specified, the output will be pessimistically treated as\n");
 		log("        driven by both combinatorial and synchronous logic.\n");
 		log("\n");
+		log("    cxxrtl_sparse\n");
+		log("        only valid on memories. if set, the memory is represented as a\n");
+		log("        `sparse_memory', which allocates storage in pages on demand, rather than\n");
+		log("        as a dense array. sparse memories are not included in debug information.\n");
+		log("        if cleared, the memory is dense regardless of the `-sparse-depth' option.\n");
+		log("\n");
 		log("The following options are supported by this backend:\n");
 		log("\n");
 		log("    -print-wire-types, -print-debug-wire-types\n");
@@ -3008,6 +3285,33 @@ struct CxxrtlBackend : public Backend {
 		log("        processes significantly improves evaluation performance at the cost of\n");
 		log("        slight increase in compilation time.\n");
 		log("\n");
+		log("    -threads <n>\n");
+		log("        split eval() of every module into at most <n> partitions that share no\n");
+		log("        state, and evaluate them concurrently. the partitions are run on the\n");
+		log("        `cxxrtl::thread_pool::shared()' thread pool, which has no worker threads\n");
+		log("        (and so evaluates partitions sequentially) until the driver resizes it.\n");
+		log("        designs consisting of many independent regions, e.g. separate clock\n");
+		log("        domains, benefit the most. the generated code defines `CXXRTL_THREADS'\n");
+		log("        before including the CXXRTL runtime, which enables the thread pool, and\n");
+		log("        must be linked with the platform threading library (e.g. `-pthread').\n");
+		log("        if the runtime is included elsewhere in the same translation unit first\n");
+		log("        (e.g. by the header of another design), `CXXRTL_THREADS' must be defined\n");
+		log("        before that, or the generated code fails to compile with an #error.\n");
+		log("\n");
+		log("    -activity\n");
+		log("        split eval() of every module into components that share no state, and\n");
+		log("        skip evaluating a component if none of the wires it reads have changed\n");
+		log("        and none of the clock edges it uses are active since it was last\n");
+		log("        evaluated. this is beneficial for designs with low toggle rates, e.g.\n");
+		log("        with idle peripherals or gated clocks. components that read writable\n");
+		log("        memories or instantiate other modules are always evaluated.\n");
+		log("\n");
+		log("    -sparse-depth <depth>\n");
+		log("        represent memories with at least <depth> words as `sparse_memory',\n");
+		log("        which allocates storage in pages when they are first written to, and\n");
+		log("        can adopt an external buffer (e.g. a mapped file) without copying it.\n");
+		log("        this option is overridden by the `cxxrtl_sparse' attribute.\n");
+		log("\n");
 		log("    -O <level>\n");
 		log("        set the optimization level. the default is -O%d. higher optimization\n", DEFAULT_OPT_LEVEL);
 		log("        levels dramatically decrease compile and run time, and highest level\n");
@@ -3126,6 +3430,22 @@ struct CxxrtlBackend : public Backend {
 				worker.split_intf = true;
 				continue;
 			}
+			if (args[argidx] == "-threads" && argidx+1 < args.size()) {
+				worker.max_partitions = std::stoi(args[++argidx]);
+				if (worker.max_partitions < 1)
+					log_cmd_error("Invalid number of partitions %d.\n", worker.max_partitions);
+				continue;
+			}
+			if (args[argidx] == "-activity") {
+				worker.track_activity = true;
+				continue;
+			}
+			if (args[argidx] == "-sparse-depth" && argidx+1 < args.size()) {
+				worker.sparse_depth = std::stoi(args[++argidx]);
+				if (worker.sparse_depth < 0)
+					log_cmd_error("Invalid sparse memory depth %d.\n", worker.sparse_depth);
+				continue;
+			}
 			if (args[argidx] == "-namespace" && argidx+1 < args.size()) {
 				worker.design_ns = args[++argidx];
 				continue;
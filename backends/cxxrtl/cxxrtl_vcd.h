@@ -19,6 +19,8 @@
 #ifndef CXXRTL_VCD_H
 #define CXXRTL_VCD_H
 
+#include <ostream>
+
 #include <backends/cxxrtl/cxxrtl.h>
 
 namespace cxxrtl {
@@ -95,26 +97,36 @@ class vcd_writer {
 		buffer += "#" + std::to_string(timestamp) + "\n";
 	}
 
-	void emit_scalar(const variable &var) {
+	void emit_scalar(const variable &var, const chunk_t *data) {
 		assert(streaming);
 		assert(var.width == 1);
-		buffer += (*var.curr ? '1' : '0');
+		buffer += (*data ? '1' : '0');
 		emit_ident(var.ident);
 		buffer += '\n';
 	}
 
-	void emit_vector(const variable &var) {
+	void emit_vector(const variable &var, const chunk_t *data) {
 		assert(streaming);
-		buffer += 'b';
+		size_t offset = buffer.size();
+		buffer.resize(offset + 1 + var.width);
+		char *text = &buffer[offset];
+		*text++ = 'b';
 		for (size_t bit = var.width - 1; bit != (size_t)-1; bit--) {
-			bool bit_curr = var.curr[bit / (8 * sizeof(chunk_t))] & (1 << (bit % (8 * sizeof(chunk_t))));
-			buffer += (bit_curr ? '1' : '0');
+			bool bit_curr = data[bit / (8 * sizeof(chunk_t))] & (1 << (bit % (8 * sizeof(chunk_t))));
+			*text++ = (bit_curr ? '1' : '0');
 		}
 		buffer += ' ';
 		emit_ident(var.ident);
 		buffer += '\n';
 	}
 
+	void emit_value(const variable &var, const chunk_t *data) {
+		if (var.width == 1)
+			emit_scalar(var, data);
+		else
+			emit_vector(var, data);
+	}
+
 	void reset_outlines() {
 		for (auto &outline_it : outlines)
 			outline_it.second = /*warm=*/(outline_it.first == nullptr);
@@ -153,6 +165,53 @@ class vcd_writer {
 		}
 	}
 
+	void start_streaming() {
+		emit_scope({});
+		emit_enddefinitions();
+	}
+
+	// `async_vcd_writer` splits sampling into two phases. The capture phase, which must run on the simulation
+	// thread, finds the variables that changed and appends their values to a compact binary log; the format
+	// phase converts the log to VCD text, and may run at any time later, on any thread. Each log record is
+	// a variable index followed by its value, or `time_record` followed by a 64-bit timestamp.
+	friend class async_vcd_writer;
+
+	static constexpr chunk_t time_record = ~chunk_t(0);
+
+	// The changed variables are found by comparing each of them with its cached value. The model does not
+	// keep track of which debug items changed: values of VALUE, ALIAS and OUTLINE items are not written
+	// through `commit()`, and flagging changed WIRE and MEMORY items in `commit()` would slow down every
+	// simulation step, whether or not a VCD file is being written.
+	void capture(uint64_t timestamp, bool all, std::vector<chunk_t> &log) {
+		reset_outlines();
+		log.push_back(chunk_t(time_record));
+		log.push_back(chunk_t(timestamp));
+		log.push_back(chunk_t(timestamp >> 32));
+		for (size_t index = 0; index < variables.size(); index++) {
+			const variable &var = variables[index];
+			if (test_variable(var) || all) {
+				const size_t chunks = (var.width + (sizeof(chunk_t) * 8 - 1)) / (sizeof(chunk_t) * 8);
+				log.push_back(chunk_t(index));
+				log.insert(log.end(), &var.curr[0], &var.curr[chunks]);
+			}
+		}
+	}
+
+	void format(const std::vector<chunk_t> &log) {
+		size_t offset = 0;
+		while (offset < log.size()) {
+			if (log[offset] == time_record) {
+				emit_time(uint64_t(log[offset + 1]) | (uint64_t(log[offset + 2]) << 32));
+				offset += 3;
+			} else {
+				const variable &var = variables[log[offset]];
+				const size_t chunks = (var.width + (sizeof(chunk_t) * 8 - 1)) / (sizeof(chunk_t) * 8);
+				emit_value(var, &log[offset + 1]);
+				offset += 1 + chunks;
+			}
+		}
+	}
+
 	static std::vector<std::string> split_hierarchy(const std::string &hier_name) {
 		std::vector<std::string> hierarchy;
 		size_t prev = 0;
@@ -241,21 +300,123 @@ public:
 
 	void sample(uint64_t timestamp) {
 		bool first_sample = !streaming;
-		if (first_sample) {
-			emit_scope({});
-			emit_enddefinitions();
-		}
+		if (first_sample)
+			start_streaming();
 		reset_outlines();
 		emit_time(timestamp);
 		for (auto var : variables)
-			if (test_variable(var) || first_sample) {
-				if (var.width == 1)
-					emit_scalar(var);
-				else
-					emit_vector(var);
+			if (test_variable(var) || first_sample)
+				emit_value(var, var.curr);
+	}
+};
+
+// A VCD writer that moves the cost of producing VCD text off the simulation thread. Calling `sample()` only
+// captures the changed values into a binary log; once enough of the log accumulates, it is handed over to
+// a background thread, which formats it and writes it to `output`. If the background thread falls behind by
+// more than one batch, `sample()` waits for it.
+//
+// The output is byte for byte the same as that of `vcd_writer`.
+//
+// Like the thread pool, this writer is only available if CXXRTL_THREADS is defined before including CXXRTL headers.
+#ifdef CXXRTL_THREADS
+class async_vcd_writer {
+	vcd_writer writer;
+	std::ostream &output;
+	size_t batch_size;
+	std::vector<chunk_t> captured, queued;
+	bool has_queued = false;
+	bool stopping = false;
+	std::mutex mutex;
+	std::condition_variable queued_cond, drained_cond;
+	std::thread thread;
+
+	void run() {
+		std::vector<chunk_t> formatting;
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true) {
+			queued_cond.wait(lock, [&] { return has_queued || stopping; });
+			if (!has_queued)
+				return;
+			formatting.swap(queued);
+			has_queued = false;
+			lock.unlock();
+			writer.format(formatting);
+			formatting.clear();
+			output.write(writer.buffer.data(), writer.buffer.size());
+			writer.buffer.clear();
+			lock.lock();
+			drained_cond.notify_all();
+		}
+	}
+
+	void hand_over(bool wait) {
+		std::unique_lock<std::mutex> lock(mutex);
+		drained_cond.wait(lock, [&] { return !has_queued; });
+		queued.swap(captured);
+		has_queued = true;
+		queued_cond.notify_one();
+		if (wait)
+			drained_cond.wait(lock, [&] { return !has_queued; });
+	}
+
+public:
+	explicit async_vcd_writer(std::ostream &output, size_t batch_size = 1 << 16)
+		: output(output), batch_size(batch_size) {}
+
+	~async_vcd_writer() {
+		if (thread.joinable()) {
+			flush();
+			{
+				std::lock_guard<std::mutex> guard(mutex);
+				stopping = true;
 			}
+			queued_cond.notify_one();
+			thread.join();
+		}
+	}
+
+	void timescale(unsigned number, const std::string &unit) {
+		writer.timescale(number, unit);
+	}
+
+	void add(const std::string &hier_name, const debug_item &item, bool multipart = false) {
+		writer.add(hier_name, item, multipart);
+	}
+
+	template<class Filter>
+	void add(const debug_items &items, const Filter &filter) {
+		writer.add(items, filter);
+	}
+
+	void add(const debug_items &items) {
+		writer.add(items);
+	}
+
+	void add_without_memories(const debug_items &items) {
+		writer.add_without_memories(items);
+	}
+
+	void sample(uint64_t timestamp) {
+		bool first_sample = !writer.streaming;
+		if (first_sample) {
+			writer.start_streaming();
+			thread = std::thread(&async_vcd_writer::run, this);
+		}
+		writer.capture(timestamp, /*all=*/first_sample, captured);
+		if (captured.size() >= batch_size)
+			hand_over(/*wait=*/false);
+	}
+
+	// Wait until everything sampled so far is written to the output stream.
+	void flush() {
+		if (!thread.joinable())
+			return;
+		hand_over(/*wait=*/true);
+		std::lock_guard<std::mutex> guard(mutex);
+		output.flush();
 	}
 };
+#endif // CXXRTL_THREADS
 
 }
 
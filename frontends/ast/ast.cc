@@ -996,6 +996,7 @@ static void process_module(RTLIL::Design *design, AstNode *ast, bool defer, AstN
 	current_module = module;
 
 	module->ast = NULL;
+	module->derive_cache = std::make_shared<AstDeriveCache>();
 	module->name = ast->str;
 	set_src_attr(module, ast);
 	module->set_bool_attribute(ID::cells_not_processed);
@@ -1324,6 +1325,12 @@ AstModule::~AstModule()
 		delete ast;
 }
 
+AstDeriveCache::~AstDeriveCache()
+{
+	for (auto &it : modules)
+		delete it.second;
+}
+
 
 // An interface port with modport is specified like this:
 //    <interface_name>.<modport_name>
@@ -1494,7 +1501,7 @@ void AstModule::reprocess_module(RTLIL::Design *design, const dict<RTLIL::IdStri
 RTLIL::IdString AstModule::derive(RTLIL::Design *design, const dict<RTLIL::IdString, RTLIL::Const> &parameters, const dict<RTLIL::IdString, RTLIL::Module*> &interfaces, const dict<RTLIL::IdString, RTLIL::IdString> &modports, bool /*mayfail*/)
 {
 	AstNode *new_ast = NULL;
-	std::string modname = derive_common(design, parameters, &new_ast);
+	std::string modname = derive_common(design, parameters, &new_ast, false, interfaces.empty());
 
 	// Since interfaces themselves may be instantiated with different parameters,
 	// "modname" must also take those into account, so that unique modules
@@ -1568,6 +1575,10 @@ RTLIL::IdString AstModule::derive(RTLIL::Design *design, const dict<RTLIL::IdStr
 			mod->set_bool_attribute(ID::interfaces_replaced_in_module);
 		}
 
+		// Variants with interface ports depend on the interface modules and are not memoized.
+		if (!has_interfaces)
+			derive_cache->modules[modname] = mod->clone();
+
 	} else {
 		modname = new_modname;
 		log("Found cached RTLIL representation for module `%s'.\n", modname.c_str());
@@ -1583,12 +1594,18 @@ RTLIL::IdString AstModule::derive(RTLIL::Design *design, const dict<RTLIL::IdStr
 	bool quiet = lib || attributes.count(ID::blackbox) || attributes.count(ID::whitebox);
 
 	AstNode *new_ast = NULL;
-	std::string modname = derive_common(design, parameters, &new_ast, quiet);
+	std::string modname = derive_common(design, parameters, &new_ast, quiet, true);
 
 	if (!design->has(modname)) {
 		new_ast->str = modname;
 		process_module(design, new_ast, false, NULL, quiet);
 		design->module(modname)->check();
+
+		// Keep a copy of the freshly elaborated module, so that the next call with the same
+		// parameters (e.g. after the module has been removed as unused, or for the blackbox
+		// derivatives that 'hierarchy' removes after each run) does not need to run the AST
+		// simplifier again.
+		derive_cache->modules[modname] = design->module(modname)->clone();
 	} else if (!quiet) {
 		log("Found cached RTLIL representation for module `%s'.\n", modname.c_str());
 	}
@@ -1621,7 +1638,7 @@ static std::string serialize_param_value(const RTLIL::Const &val) {
 }
 
 // create a new parametric module (when needed) and return the name of the generated module
-std::string AstModule::derive_common(RTLIL::Design *design, const dict<RTLIL::IdString, RTLIL::Const> &parameters, AstNode **new_ast_out, bool quiet)
+std::string AstModule::derive_common(RTLIL::Design *design, const dict<RTLIL::IdString, RTLIL::Const> &parameters, AstNode **new_ast_out, bool quiet, bool memoized)
 {
 	std::string stripped_name = name.str();
 
@@ -1662,6 +1679,14 @@ std::string AstModule::derive_common(RTLIL::Design *design, const dict<RTLIL::Id
 	if (design->has(modname))
 		return modname;
 
+	if (memoized) {
+		auto it = derive_cache->modules.find(modname);
+		if (it != derive_cache->modules.end()) {
+			design->add(it->second->clone());
+			return modname;
+		}
+	}
+
 	if (!quiet)
 		log_header(design, "Executing AST frontend in derive mode using pre-parsed AST for module `%s'.\n", stripped_name.c_str());
 	loadconfig();
@@ -1740,6 +1765,7 @@ RTLIL::Module *AstModule::clone() const
 	new_mod->icells = icells;
 	new_mod->pwires = pwires;
 	new_mod->autowire = autowire;
+	new_mod->derive_cache = derive_cache;
 
 	return new_mod;
 }
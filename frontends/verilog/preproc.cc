@@ -35,49 +35,60 @@
 #include "preproc.h"
 #include "verilog_frontend.h"
 #include "kernel/log.h"
+#include "libs/sha1/sha1.h"
 #include <assert.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/stat.h>
 
 YOSYS_NAMESPACE_BEGIN
 using namespace VERILOG_FRONTEND;
 
-static std::list<std::string> output_code;
-static std::list<std::string> input_buffer;
-static size_t input_buffer_charp;
+// The preprocessor state is per thread, so that several files can be preprocessed concurrently
+// (see frontend_verilog_preproc_worker()).
+//
+// The remaining input is kept in a single buffer in reverse order: the next character is at the
+// end of the buffer, so that pushing back characters and inserting macro bodies or included files
+// in front of the remaining input are simple appends.
+static thread_local std::string output_code;
+static thread_local std::string input_buffer;
+
+// When running on a worker thread, errors abort the run instead of being logged, and the uses
+// of and changes to macro definitions are recorded in current_usage.
+struct preproc_speculation_failed { };
+static thread_local bool speculative;
+static thread_local preproc_usage_t *current_usage;
+
+[[noreturn]] static void preproc_error(const char *format, ...) YS_ATTRIBUTE(format(printf, 1, 2));
+static void preproc_error(const char *format, ...)
+{
+	if (speculative)
+		throw preproc_speculation_failed();
+	va_list ap;
+	va_start(ap, format);
+	logv_error(format, ap);
+}
 
 static void return_char(char ch)
 {
-	if (input_buffer_charp == 0)
-		input_buffer.push_front(std::string() + ch);
-	else
-		input_buffer.front()[--input_buffer_charp] = ch;
+	input_buffer.push_back(ch);
 }
 
-static void insert_input(std::string str)
+static void insert_input(const std::string &str)
 {
-	if (input_buffer_charp != 0) {
-		input_buffer.front() = input_buffer.front().substr(input_buffer_charp);
-		input_buffer_charp = 0;
-	}
-	input_buffer.push_front(str);
+	input_buffer.append(str.rbegin(), str.rend());
 }
 
 static char next_char()
 {
-	if (input_buffer.empty())
-		return 0;
-
-	log_assert(input_buffer_charp <= input_buffer.front().size());
-	if (input_buffer_charp == input_buffer.front().size()) {
-		input_buffer_charp = 0;
-		input_buffer.pop_front();
-		return next_char();
+	while (!input_buffer.empty()) {
+		char ch = input_buffer.back();
+		input_buffer.pop_back();
+		if (ch != '\r')
+			return ch;
 	}
-
-	char ch = input_buffer.front()[input_buffer_charp++];
-	return ch == '\r' ? next_char() : ch;
+	return 0;
 }
 
 static std::string skip_spaces()
@@ -107,7 +118,7 @@ static std::string next_token(bool pass_newline = false)
 	token += ch;
 	if (ch == '\n') {
 		if (pass_newline) {
-			output_code.push_back(token);
+			output_code += token;
 			return "";
 		}
 		return token;
@@ -230,7 +241,7 @@ struct arg_map_t
 	void add_arg(const std::string &name, const char *default_value)
 	{
 		if (find(name)) {
-			log_error("Duplicate macro arguments with name `%s'.\n", name.c_str());
+			preproc_error("Duplicate macro arguments with name `%s'.\n", name.c_str());
 		}
 
 		name_to_pos[name] = args.size();
@@ -289,7 +300,7 @@ struct arg_map_t
 			else if (given)
 				val = given;
 			else
-				log_error("Cannot expand macro `%s by giving only %d argument%s "
+				preproc_error("Cannot expand macro `%s by giving only %d argument%s "
 				          "(argument %d has no default).\n",
 				          macro_name.c_str(), GetSize(arg_vals),
 				          (GetSize(arg_vals) == 1 ? "" : "s"), i + 1);
@@ -331,16 +342,14 @@ define_map_t::~define_map_t()
 void
 define_map_t::add(const std::string &name, const std::string &txt, const arg_map_t *args)
 {
-	defines[name] = std::unique_ptr<define_body_t>(new define_body_t(txt, args));
+	defines[name] = std::make_shared<const define_body_t>(txt, args);
 }
 
 void define_map_t::merge(const define_map_t &map)
 {
-	for (const auto &pr : map.defines) {
-		// These contortions are so that we take a copy of each definition body in
-		// map.defines.
-		defines[pr.first] = std::unique_ptr<define_body_t>(new define_body_t(*pr.second));
-	}
+	// Definition bodies are never modified, so they can be shared between maps.
+	for (const auto &pr : map.defines)
+		defines[pr.first] = pr.second;
 }
 
 const define_body_t *define_map_t::find(const std::string &name) const
@@ -369,20 +378,289 @@ void define_map_t::log() const
 	}
 }
 
-static void input_file(std::istream &f, std::string filename)
+static bool same_define(const define_body_t *a, const define_body_t *b)
+{
+	if (a == b)
+		return true;
+	if (a == nullptr || b == nullptr || a->body != b->body || a->has_args != b->has_args)
+		return false;
+	if (GetSize(a->args.args) != GetSize(b->args.args))
+		return false;
+	for (int i = 0; i < GetSize(a->args.args); i++) {
+		const macro_arg_t &arg_a = a->args.args[i], &arg_b = b->args.args[i];
+		if (arg_a.name != arg_b.name || arg_a.has_default != arg_b.has_default || arg_a.default_value != arg_b.default_value)
+			return false;
+	}
+	return true;
+}
+
+struct preproc_include_cache_t::memo_t
+{
+	// include path and working directory, which determine how nested includes are resolved
+	std::string context;
+	// the macros looked up before the file changed them, with their values (nullptr if undefined)
+	dict<std::string, std::shared_ptr<const define_body_t>> used_defines;
+	// the final values of the macros changed by the file
+	dict<std::string, std::shared_ptr<const define_body_t>> local_changes, global_changes;
+	// nested include files, with the version of their contents
+	std::vector<std::pair<std::string, int>> input_files;
+	std::string output;
+};
+
+// An include file that is being preprocessed and will be memoized when its `file_pop is reached.
+struct include_recording_t
+{
+	std::shared_ptr<preproc_include_cache_t::memo_t> memo;
+	std::string filename;
+	int version;
+	size_t depth, output_start;
+	int pass_level;
+	pool<std::string> changed, changed_global;
+	bool valid = true;
+};
+static thread_local std::vector<include_recording_t> include_recordings;
+
+static const define_body_t *find_define(const define_map_t &defines, const std::string &name)
+{
+	if (current_usage != nullptr)
+		current_usage->used_defines.insert(name);
+	auto it = defines.defines.find(name);
+	for (auto &rec : include_recordings)
+		if (!rec.changed.count(name) && !rec.memo->used_defines.count(name))
+			rec.memo->used_defines[name] = it != defines.defines.end() ? it->second : nullptr;
+	return it != defines.defines.end() ? it->second.get() : nullptr;
+}
+
+static void define_changed(const std::string &name, bool global)
+{
+	if (global && current_usage != nullptr)
+		current_usage->changed_defines.insert(name);
+	for (auto &rec : include_recordings) {
+		rec.changed.insert(name);
+		if (global)
+			rec.changed_global.insert(name);
+	}
+}
+
+static std::string include_context(const std::list<std::string> &include_dirs)
+{
+	std::string context;
+	for (auto &dir : include_dirs)
+		context += dir + "\n";
+	char *cwd = getcwd(nullptr, 0);
+	if (cwd != nullptr) {
+		context += cwd;
+		free(cwd);
+	}
+	return context;
+}
+
+static void record_include(preproc_include_cache_t *include_cache, const std::string &filename, size_t depth, int pass_level)
+{
+	for (auto &rec : include_recordings)
+		rec.memo->input_files.push_back(std::make_pair(filename, include_cache->at(filename).version));
+
+	include_recording_t rec;
+	rec.memo = std::make_shared<preproc_include_cache_t::memo_t>();
+	rec.filename = filename;
+	rec.version = include_cache->at(filename).version;
+	rec.depth = depth;
+	rec.output_start = output_code.size();
+	rec.pass_level = pass_level;
+	include_recordings.push_back(std::move(rec));
+}
+
+static void finish_include(preproc_include_cache_t *include_cache, const std::list<std::string> &include_dirs,
+		define_map_t &defines, define_map_t &global_defines_cache, int pass_level)
 {
-	char buffer[513];
+	include_recording_t rec = std::move(include_recordings.back());
+	include_recordings.pop_back();
+	if (!rec.valid || rec.pass_level != pass_level)
+		return;
+
+	auto it = include_cache->entries.find(preproc_include_cache_t::absolute_path(rec.filename));
+	if (it == include_cache->entries.end() || it->second.version != rec.version)
+		return;
+
+	auto &memo = *rec.memo;
+	memo.context = include_context(include_dirs);
+	for (auto &name : rec.changed) {
+		auto def = defines.defines.find(name);
+		memo.local_changes[name] = def != defines.defines.end() ? def->second : nullptr;
+	}
+	for (auto &name : rec.changed_global) {
+		auto def = global_defines_cache.defines.find(name);
+		memo.global_changes[name] = def != global_defines_cache.defines.end() ? def->second : nullptr;
+	}
+	memo.output = output_code.substr(rec.output_start);
+
+	// keep a few variants, e.g. for headers that are included with different configurations
+	auto &memos = it->second.memos;
+	if (GetSize(memos) >= 4)
+		memos.erase(memos.begin());
+	memos.push_back(rec.memo);
+}
+
+// An include file that leaves a conditional block opened before it was included can't be memoized.
+static void left_conditional(int pass_level)
+{
+	for (auto &rec : include_recordings)
+		if (pass_level < rec.pass_level)
+			rec.valid = false;
+}
+
+// Replay the memoized result of an include file, if there is one that is valid in the current context.
+static bool replay_include(preproc_include_cache_t *include_cache, const std::string &filename,
+		const std::list<std::string> &include_dirs, define_map_t &defines, define_map_t &global_defines_cache)
+{
+	auto entry = include_cache->lookup(filename);
+	if (entry == nullptr || entry->memos.empty())
+		return false;
+	int version = entry->version;
+	std::vector<std::shared_ptr<preproc_include_cache_t::memo_t>> memos = entry->memos;
+	std::string context = include_context(include_dirs);
+
+	for (auto &memo : memos) {
+		if (memo->context != context)
+			continue;
+		bool match = true;
+		for (auto &it : memo->used_defines)
+			if (!same_define(defines.find(it.first), it.second.get())) {
+				match = false;
+				break;
+			}
+		for (auto &it : memo->input_files) {
+			if (!match)
+				break;
+			auto nested = include_cache->lookup(it.first);
+			match = nested != nullptr && nested->version == it.second;
+		}
+		if (!match)
+			continue;
+
+		for (auto &it : memo->used_defines)
+			find_define(defines, it.first);
+		for (auto &it : memo->local_changes) {
+			if (it.second == nullptr)
+				defines.erase(it.first);
+			else
+				defines.defines[it.first] = it.second;
+			define_changed(it.first, memo->global_changes.count(it.first) != 0);
+		}
+		for (auto &it : memo->global_changes) {
+			if (it.second == nullptr)
+				global_defines_cache.erase(it.first);
+			else
+				global_defines_cache.defines[it.first] = it.second;
+		}
+
+		for (auto &rec : include_recordings) {
+			rec.memo->input_files.push_back(std::make_pair(filename, version));
+			for (auto &it : memo->input_files)
+				rec.memo->input_files.push_back(it);
+		}
+		if (current_usage != nullptr)
+			current_usage->input_files.push_back(filename);
+		if (!speculative)
+			yosys_input_files.insert(filename);
+		for (auto &it : memo->input_files) {
+			if (current_usage != nullptr)
+				current_usage->input_files.push_back(it.first);
+			if (!speculative)
+				yosys_input_files.insert(it.first);
+		}
+
+		output_code += memo->output;
+		return true;
+	}
+	return false;
+}
+
+static void input_file(const std::string &contents, const std::string &filename)
+{
+	insert_input("\n`file_pop\n");
+	insert_input(contents);
+	insert_input("`file_push \"" + filename + "\"\n");
+}
+
+static void input_file(std::istream &f, const std::string &filename)
+{
+	char buffer[4096];
 	int rc;
 
-	insert_input("");
-	auto it = input_buffer.begin();
+	std::string contents;
+	while ((rc = readsome(f, buffer, sizeof(buffer))) > 0)
+		contents.append(buffer, rc);
+	input_file(contents, filename);
+}
 
-	input_buffer.insert(it, "`file_push \"" + filename + "\"\n");
-	while ((rc = readsome(f, buffer, sizeof(buffer)-1)) > 0) {
-		buffer[rc] = 0;
-		input_buffer.insert(it, buffer);
+std::string preproc_include_cache_t::absolute_path(const std::string &filename)
+{
+	if (filename.empty() || is_absolute_path(filename))
+		return filename;
+	std::string path;
+	char *cwd = getcwd(nullptr, 0);
+	if (cwd != nullptr) {
+		path = cwd;
+		free(cwd);
 	}
-	input_buffer.insert(it, "\n`file_pop\n");
+	return path + "/" + filename;
+}
+
+preproc_include_cache_t::entry_t &preproc_include_cache_t::at(const std::string &filename)
+{
+	return entries.at(absolute_path(filename));
+}
+
+preproc_include_cache_t::entry_t *preproc_include_cache_t::lookup(const std::string &filename)
+{
+	struct stat st;
+	if (stat(filename.c_str(), &st) != 0 || (st.st_mode & S_IFMT) != S_IFREG)
+		return nullptr;
+
+	std::string path = absolute_path(filename);
+	auto it = entries.find(path);
+	if (it != entries.end() && it->second.mtime == st.st_mtime && it->second.size == st.st_size &&
+			it->second.mtime < it->second.read_time)
+		return &it->second;
+
+	std::ifstream f(filename, std::ifstream::binary);
+	if (f.fail())
+		return nullptr;
+	std::stringstream buffer;
+	buffer << f.rdbuf();
+
+	entry_t &entry = entries[path];
+	std::string hash = sha1(buffer.str());
+	if (entry.hash != hash) {
+		entry.contents = buffer.str();
+		entry.hash = hash;
+		entry.version = next_version++;
+		entry.memos.clear();
+	}
+	entry.mtime = st.st_mtime;
+	entry.size = st.st_size;
+	entry.read_time = time(nullptr);
+	return &entry;
+}
+
+static bool read_include_file(preproc_include_cache_t *include_cache, const std::string &filename, std::string &contents)
+{
+	if (include_cache != nullptr) {
+		auto entry = include_cache->lookup(filename);
+		if (entry == nullptr)
+			return false;
+		contents = entry->contents;
+		return true;
+	}
+
+	std::ifstream f(filename);
+	if (f.fail())
+		return false;
+	std::stringstream buffer;
+	buffer << f.rdbuf();
+	contents = buffer.str();
+	return true;
 }
 
 // Read tokens to get one argument (either a macro argument at a callsite or a default argument in a
@@ -401,7 +679,7 @@ static bool read_argument(std::string &dest)
 				return true;
 			}
 			if (openers.back() != '(')
-				log_error("Mismatched brackets in macro argument: %c and %c.\n",
+				preproc_error("Mismatched brackets in macro argument: %c and %c.\n",
 				          openers.back(), tok[0]);
 
 			openers.pop_back();
@@ -411,7 +689,7 @@ static bool read_argument(std::string &dest)
 		if (tok == "]") {
 			char opener = openers.empty() ? '(' : openers.back();
 			if (opener != '[')
-				log_error("Mismatched brackets in macro argument: %c and %c.\n",
+				preproc_error("Mismatched brackets in macro argument: %c and %c.\n",
 				          opener, tok[0]);
 
 			openers.pop_back();
@@ -421,7 +699,7 @@ static bool read_argument(std::string &dest)
 		if (tok == "}") {
 			char opener = openers.empty() ? '(' : openers.back();
 			if (opener != '{')
-				log_error("Mismatched brackets in macro argument: %c and %c.\n",
+				preproc_error("Mismatched brackets in macro argument: %c and %c.\n",
 				          opener, tok[0]);
 
 			openers.pop_back();
@@ -467,7 +745,7 @@ static bool try_expand_macro(define_map_t &defines, std::string &tok)
 
 	// This token looks like a macro name (`foo).
 	std::string macro_name = tok.substr(1);
-	const define_body_t *body = defines.find(tok.substr(1));
+	const define_body_t *body = find_define(defines, tok.substr(1));
 
 	if (! body) {
 		// Apparently not a name we know.
@@ -484,7 +762,7 @@ static bool try_expand_macro(define_map_t &defines, std::string &tok)
 				snprintf(buf, sizeof(buf), "\\x%02x", tok[0]);
 				tok = buf;
 			}
-			log_error("Expected to find '(' to begin macro arguments for '%s', but instead found '%s'\n",
+			preproc_error("Expected to find '(' to begin macro arguments for '%s', but instead found '%s'\n",
 				name.c_str(), tok.c_str());
 		}
 		std::vector<std::string> args;
@@ -496,6 +774,7 @@ static bool try_expand_macro(define_map_t &defines, std::string &tok)
 		}
 		for (const auto &pr : body->args.get_vals(name, args)) {
 			defines.add(pr.first, pr.second);
+			define_changed(pr.first, false);
 		}
 	} else {
 		insert_input(tok);
@@ -551,7 +830,7 @@ read_define_args()
 				continue;
 			} else {
 				// There aren't any other situations where a backslash makes sense.
-				log_error("Backslash in macro arguments (not at end of line).\n");
+				preproc_error("Backslash in macro arguments (not at end of line).\n");
 			}
 		}
 
@@ -596,7 +875,7 @@ read_define_args()
 				skip_spaces();
 				break;
 			}
-			log_error("Trailing contents after identifier in macro argument `%s': "
+			preproc_error("Trailing contents after identifier in macro argument `%s': "
 				  "expected '=', ',' or ')'.\n",
 				  arg_name.c_str());
 
@@ -708,8 +987,11 @@ read_define(const std::string &filename,
 	if (strchr("abcdefghijklmnopqrstuvwxyz_ABCDEFGHIJKLMNOPQRSTUVWXYZ$0123456789", name[0])) {
 		// printf("define: >>%s<< -> >>%s<<\n", name.c_str(), value.c_str());
 		defines_map.add(name, value, (state == 2) ? &args : nullptr);
-		global_defines_cache.add(name, value, (state == 2) ? &args : nullptr);
+		global_defines_cache.defines[name] = defines_map.defines.at(name);
+		define_changed(name, true);
 	} else {
+		if (speculative)
+			throw preproc_speculation_failed();
 		log_file_error(filename, 0, "Invalid name for macro definition: >>%s<<.\n", name.c_str());
 	}
 }
@@ -719,8 +1001,12 @@ frontend_verilog_preproc(std::istream                 &f,
                          std::string                   filename,
                          const define_map_t           &pre_defines,
                          define_map_t                 &global_defines_cache,
-                         const std::list<std::string> &include_dirs)
+                         const std::list<std::string> &include_dirs,
+                         preproc_include_cache_t      *include_cache,
+                         preproc_usage_t              *usage)
 {
+	current_usage = usage;
+
 	define_map_t defines;
 	defines.merge(pre_defines);
 	defines.merge(global_defines_cache);
@@ -740,7 +1026,7 @@ frontend_verilog_preproc(std::istream                 &f,
 
 	output_code.clear();
 	input_buffer.clear();
-	input_buffer_charp = 0;
+	include_recordings.clear();
 
 	input_file(f, filename);
 
@@ -749,21 +1035,28 @@ frontend_verilog_preproc(std::istream                 &f,
 		std::string tok = next_token();
 		// printf("token: >>%s<<\n", tok != "\n" ? tok.c_str() : "NEWLINE");
 
+		// Only tokens starting with a backtick can be directives or macro calls.
+		if (tok.empty() || tok[0] != '`') {
+			if (ifdef_fail_level == 0 || tok == "\n")
+				output_code += tok;
+			continue;
+		}
+
 		if (tok == "`endif") {
 			if (ifdef_fail_level > 0)
 				ifdef_fail_level--;
 			else if (ifdef_pass_level > 0)
-				ifdef_pass_level--;
+				left_conditional(--ifdef_pass_level);
 			else
-				log_error("Found %s outside of macro conditional branch!\n", tok.c_str());
+				preproc_error("Found %s outside of macro conditional branch!\n", tok.c_str());
 			continue;
 		}
 
 		if (tok == "`else") {
 			if (ifdef_fail_level == 0) {
 				if (ifdef_pass_level == 0)
-					log_error("Found %s outside of macro conditional branch!\n", tok.c_str());
-				ifdef_pass_level--;
+					preproc_error("Found %s outside of macro conditional branch!\n", tok.c_str());
+				left_conditional(--ifdef_pass_level);
 				ifdef_fail_level = 1;
 				ifdef_already_satisfied = true;
 			} else if (ifdef_fail_level == 1 && !ifdef_already_satisfied) {
@@ -779,11 +1072,11 @@ frontend_verilog_preproc(std::istream                 &f,
 			std::string name = next_token(true);
 			if (ifdef_fail_level == 0) {
 				if (ifdef_pass_level == 0)
-					log_error("Found %s outside of macro conditional branch!\n", tok.c_str());
-				ifdef_pass_level--;
+					preproc_error("Found %s outside of macro conditional branch!\n", tok.c_str());
+				left_conditional(--ifdef_pass_level);
 				ifdef_fail_level = 1;
 				ifdef_already_satisfied = true;
-			} else if (ifdef_fail_level == 1 && !ifdef_already_satisfied && defines.find(name)) {
+			} else if (ifdef_fail_level == 1 && !ifdef_already_satisfied && find_define(defines, name)) {
 				ifdef_fail_level = 0;
 				ifdef_pass_level++;
 				ifdef_already_satisfied = true;
@@ -794,7 +1087,7 @@ frontend_verilog_preproc(std::istream                 &f,
 		if (tok == "`ifdef") {
 			skip_spaces();
 			std::string name = next_token(true);
-			if (ifdef_fail_level > 0 || !defines.find(name)) {
+			if (ifdef_fail_level > 0 || !find_define(defines, name)) {
 				ifdef_fail_level++;
 			} else {
 				ifdef_pass_level++;
@@ -808,7 +1101,7 @@ frontend_verilog_preproc(std::istream                 &f,
 		if (tok == "`ifndef") {
 			skip_spaces();
 			std::string name = next_token(true);
-			if (ifdef_fail_level > 0 || defines.find(name)) {
+			if (ifdef_fail_level > 0 || find_define(defines, name)) {
 				ifdef_fail_level++;
 			} else {
 				ifdef_pass_level++;
@@ -821,7 +1114,7 @@ frontend_verilog_preproc(std::istream                 &f,
 
 		if (ifdef_fail_level > 0) {
 			if (tok == "\n")
-				output_code.push_back(tok);
+				output_code += tok;
 			continue;
 		}
 
@@ -840,10 +1133,8 @@ frontend_verilog_preproc(std::istream                 &f,
 				else
 					fn = fn.substr(0, pos) + fn.substr(pos+1);
 			}
-			std::ifstream ff;
-			ff.clear();
-			std::string fixed_fn = fn;
-			ff.open(fixed_fn.c_str());
+			std::string fixed_fn = fn, contents;
+			bool found = read_include_file(include_cache, fixed_fn, contents);
 
 			bool filename_path_sep_found;
 			bool fn_relative;
@@ -857,32 +1148,40 @@ frontend_verilog_preproc(std::istream                 &f,
 			fn_relative = (fn[0] != '/');
 #endif
 
-			if (ff.fail() && fn.size() > 0 && fn_relative && filename_path_sep_found) {
+			if (!found && fn.size() > 0 && fn_relative && filename_path_sep_found) {
 				// if the include file was not found, it is not given with an absolute path, and the
 				// currently read file is given with a path, then try again relative to its directory
-				ff.clear();
 #ifdef _WIN32
 				fixed_fn = filename.substr(0, filename.find_last_of("/\\")+1) + fn;
 #else
 				fixed_fn = filename.substr(0, filename.rfind('/')+1) + fn;
 #endif
-				ff.open(fixed_fn);
+				found = read_include_file(include_cache, fixed_fn, contents);
 			}
-			if (ff.fail() && fn.size() > 0 && fn_relative) {
+			if (!found && fn.size() > 0 && fn_relative) {
 				// if the include file was not found and it is not given with an absolute path, then
 				// search it in the include path
 				for (auto incdir : include_dirs) {
-					ff.clear();
 					fixed_fn = incdir + '/' + fn;
-					ff.open(fixed_fn);
-					if (!ff.fail()) break;
+					found = read_include_file(include_cache, fixed_fn, contents);
+					if (found) break;
 				}
 			}
-			if (ff.fail()) {
-				output_code.push_back("`file_notfound " + fn);
+			if (!found) {
+				output_code += "`file_notfound " + fn;
+				for (auto &rec : include_recordings)
+					rec.valid = false;
+			} else if (include_cache != nullptr && replay_include(include_cache, fixed_fn, include_dirs, defines, global_defines_cache)) {
+				// the newline after the `file_pop of the include file
+				return_char('\n');
 			} else {
-				input_file(ff, fixed_fn);
-				yosys_input_files.insert(fixed_fn);
+				if (include_cache != nullptr)
+					record_include(include_cache, fixed_fn, filename_stack.size(), ifdef_pass_level);
+				input_file(contents, fixed_fn);
+				if (current_usage != nullptr)
+					current_usage->input_files.push_back(fixed_fn);
+				if (!speculative)
+					yosys_input_files.insert(fixed_fn);
 			}
 			continue;
 		}
@@ -892,16 +1191,18 @@ frontend_verilog_preproc(std::istream                 &f,
 			std::string fn = next_token(true);
 			if (!fn.empty() && fn.front() == '"' && fn.back() == '"')
 				fn = fn.substr(1, fn.size()-2);
-			output_code.push_back(tok + " \"" + fn + "\"");
+			output_code += tok + " \"" + fn + "\"";
 			filename_stack.push_back(filename);
 			filename = fn;
 			continue;
 		}
 
 		if (tok == "`file_pop") {
-			output_code.push_back(tok);
+			output_code += tok;
 			filename = filename_stack.back();
 			filename_stack.pop_back();
+			if (!include_recordings.empty() && include_recordings.back().depth == filename_stack.size())
+				finish_include(include_cache, include_dirs, defines, global_defines_cache, ifdef_pass_level);
 			continue;
 		}
 
@@ -917,6 +1218,7 @@ frontend_verilog_preproc(std::istream                 &f,
 			// printf("undef: >>%s<<\n", name.c_str());
 			defines.erase(name);
 			global_defines_cache.erase(name);
+			define_changed(name, true);
 			continue;
 		}
 
@@ -932,28 +1234,94 @@ frontend_verilog_preproc(std::istream                 &f,
 		if (tok == "`resetall") {
 			defines.clear();
 			global_defines_cache.clear();
+			if (current_usage != nullptr)
+				current_usage->reset_defines = true;
+			for (auto &rec : include_recordings)
+				rec.valid = false;
 			continue;
 		}
 
 		if (try_expand_macro(defines, tok))
 			continue;
 
-		output_code.push_back(tok);
+		output_code += tok;
 	}
 
 	if (ifdef_fail_level > 0 || ifdef_pass_level > 0) {
-		log_error("Unterminated preprocessor conditional!\n");
+		preproc_error("Unterminated preprocessor conditional!\n");
 	}
 
-	std::string output;
-	for (auto &str : output_code)
-		output += str;
+	std::string output = std::move(output_code);
 
 	output_code.clear();
 	input_buffer.clear();
-	input_buffer_charp = 0;
+	include_recordings.clear();
+	current_usage = nullptr;
 
 	return output;
 }
 
+bool
+frontend_verilog_preproc_worker(const std::string            &filename,
+                                const define_map_t           &pre_defines,
+                                define_map_t                 &global_defines_cache,
+                                const std::list<std::string> &include_dirs,
+                                std::string                  &output,
+                                preproc_usage_t              &usage)
+{
+	std::ifstream f(filename);
+	if (f.fail())
+		return false;
+
+	// compressed input is left to the main thread
+	int magic0 = f.get(), magic1 = f.get();
+	if (magic0 == 0x1f && magic1 == 0x8b)
+		return false;
+	f.clear();
+	f.seekg(0, std::ios::beg);
+
+	speculative = true;
+	try {
+		output = frontend_verilog_preproc(f, filename, pre_defines, global_defines_cache, include_dirs, nullptr, &usage);
+	} catch (preproc_speculation_failed&) {
+		output_code.clear();
+		input_buffer.clear();
+		current_usage = nullptr;
+		speculative = false;
+		return false;
+	}
+	speculative = false;
+	return true;
+}
+
+bool
+frontend_verilog_preproc_commit(const preproc_usage_t &usage,
+                                const pool<std::string> &changed_defines,
+                                bool                   defines_reset,
+                                const define_map_t    &worker_defines_cache,
+                                define_map_t          &global_defines_cache)
+{
+	if (defines_reset)
+		return false;
+	for (auto &name : usage.used_defines)
+		if (changed_defines.count(name))
+			return false;
+
+	if (usage.reset_defines) {
+		global_defines_cache.clear();
+		global_defines_cache.merge(worker_defines_cache);
+	} else {
+		for (auto &name : usage.changed_defines) {
+			auto it = worker_defines_cache.defines.find(name);
+			if (it == worker_defines_cache.defines.end())
+				global_defines_cache.erase(name);
+			else
+				global_defines_cache.defines[name] = it->second;
+		}
+	}
+	for (auto &fn : usage.input_files)
+		yosys_input_files.insert(fn);
+	return true;
+}
+
 YOSYS_NAMESPACE_END
@@ -59,18 +59,83 @@ struct define_map_t
 	// Print a list of definitions, using the log function
 	void log() const;
 
-	std::map<std::string, std::unique_ptr<define_body_t>> defines;
+	std::map<std::string, std::shared_ptr<const define_body_t>> defines;
 };
 
 
 struct define_map_t;
 
+// The macros a preprocessor run looked up, the global definitions it changed and the files
+// it included. Used to preprocess several files concurrently (see read_verilog -threads).
+struct preproc_usage_t
+{
+	pool<std::string> used_defines;
+	pool<std::string> changed_defines;
+	bool reset_defines = false;
+	std::vector<std::string> input_files;
+};
+
+// The files included by the Verilog frontend, kept for the whole session so that headers included
+// by many files (or by many read_verilog commands) are only read once. An entry is used as long as
+// the modification time and size of the file are unchanged (and the file was not modified in the
+// second it was read), otherwise the file is read again and compared with the cached contents.
+//
+// For each file, the output and macro definitions resulting from preprocessing it are also kept,
+// together with the values of the macros it looked up, so that an include file does not need to
+// be preprocessed again when it is included with the same relevant macros defined.
+struct preproc_include_cache_t
+{
+	struct memo_t;
+
+	struct entry_t {
+		std::string contents, hash;
+		int64_t mtime, size, read_time;
+		int version;
+		std::vector<std::shared_ptr<memo_t>> memos;
+	};
+	// indexed by absolute path, as relative paths depend on the working directory
+	dict<std::string, entry_t> entries;
+	int next_version = 1;
+
+	// Look up a file, reading it if it is not cached or has changed. Returns nullptr if the file
+	// does not exist or can't be read. The pointer is invalidated by the next call.
+	entry_t *lookup(const std::string &filename);
+
+	// Returns the entry of a file that has been looked up before.
+	entry_t &at(const std::string &filename);
+
+	static std::string absolute_path(const std::string &filename);
+};
+
 std::string
 frontend_verilog_preproc(std::istream                 &f,
                          std::string                   filename,
                          const define_map_t           &pre_defines,
                          define_map_t                 &global_defines_cache,
-                         const std::list<std::string> &include_dirs);
+                         const std::list<std::string> &include_dirs,
+                         preproc_include_cache_t      *include_cache = nullptr,
+                         preproc_usage_t              *usage = nullptr);
+
+// Preprocess a file on a worker thread, using a private copy of the global defines. No log
+// functions are called: returns false if the file can't be read or the preprocessor would
+// have reported an error, in which case it must be preprocessed on the main thread instead.
+bool
+frontend_verilog_preproc_worker(const std::string            &filename,
+                                const define_map_t           &pre_defines,
+                                define_map_t                 &global_defines_cache,
+                                const std::list<std::string> &include_dirs,
+                                std::string                  &output,
+                                preproc_usage_t              &usage);
+
+// Check whether the result of frontend_verilog_preproc_worker() is still valid, given the global
+// definitions changed (or reset) by the files preprocessed before it, and if so apply its changes
+// to the global defines. Returns false if the file must be preprocessed again.
+bool
+frontend_verilog_preproc_commit(const preproc_usage_t   &usage,
+                                const pool<std::string> &changed_defines,
+                                bool                     defines_reset,
+                                const define_map_t      &worker_defines_cache,
+                                define_map_t            &global_defines_cache);
 
 YOSYS_NAMESPACE_END
 
@@ -29,6 +29,7 @@
 #include "verilog_frontend.h"
 #include "preproc.h"
 #include "kernel/yosys.h"
+#include "kernel/threading.h"
 #include "libs/sha1/sha1.h"
 #include <stdarg.h>
 
@@ -65,6 +66,51 @@ static void add_package_types(dict<std::string, AST::AstNode *> &user_types, std
 
 struct VerilogFrontend : public Frontend {
 	VerilogFrontend() : Frontend("verilog", "read modules from Verilog file") { }
+
+	// Included files and the memoized results of preprocessing them, kept for the whole session
+	preproc_include_cache_t include_cache;
+
+	// With -threads, the files of a multi-file read_verilog command are preprocessed ahead of time
+	// on worker threads, each with a snapshot of the global defines. A result is only used if none
+	// of the macros it looked up have been changed by the files read before it.
+	struct PreprocResult {
+		bool ok = false;
+		std::string output;
+		preproc_usage_t usage;
+		define_map_t defines_cache;
+	};
+	std::map<std::string, PreprocResult> preproc_results;
+	std::vector<std::string> preproc_pending;
+	pool<std::string> preproc_changed_defines;
+	bool preproc_defines_reset = false;
+
+	void preprocess_ahead(const std::vector<std::string> &filenames, const define_map_t &pre_defines,
+			const define_map_t &global_defines_cache, const std::list<std::string> &include_dirs, int threads)
+	{
+		std::vector<std::string> job_filenames;
+		std::vector<PreprocResult*> jobs;
+		for (auto &fn : filenames) {
+			if (preproc_results.count(fn))
+				continue;
+			PreprocResult &result = preproc_results[fn];
+			result.defines_cache.clear();
+			result.defines_cache.merge(global_defines_cache);
+			job_filenames.push_back(fn);
+			jobs.push_back(&result);
+		}
+
+		parallel_for(threads, GetSize(jobs), [&](int i) {
+			jobs[i]->ok = frontend_verilog_preproc_worker(job_filenames[i], pre_defines, jobs[i]->defines_cache,
+					include_dirs, jobs[i]->output, jobs[i]->usage);
+		});
+
+		preproc_pending = filenames;
+		std::reverse(preproc_pending.begin(), preproc_pending.end());
+		preproc_changed_defines.clear();
+		preproc_defines_reset = false;
+		log("Preprocessed %d files on %d threads.\n", GetSize(jobs), std::min(threads, GetSize(jobs)));
+	}
+
 	void help() override
 	{
 		//   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
@@ -161,6 +207,14 @@ struct VerilogFrontend : public Frontend {
 		log("    -nopp\n");
 		log("        do not run the pre-processor\n");
 		log("\n");
+		log("    -threads <N>\n");
+		log("        when reading multiple files, run the pre-processor for all of them\n");
+		log("        ahead of time on N threads (0 = one per core). files that use macros\n");
+		log("        changed by a file read before them are pre-processed again. parsing\n");
+		log("        and elaboration always happen one file at a time, and usually take\n");
+		log("        most of the time, so this only helps for designs in which the\n");
+		log("        pre-processor does a lot of work, e.g. because of large include files.\n");
+		log("\n");
 		log("    -nodpi\n");
 		log("        disable DPI-C support\n");
 		log("\n");
@@ -257,6 +311,7 @@ struct VerilogFrontend : public Frontend {
 		bool flag_noblackbox = false;
 		bool flag_nowb = false;
 		bool flag_nosynthesis = false;
+		int preproc_threads = 1;
 		define_map_t defines_map;
 
 		std::list<std::string> include_dirs;
@@ -368,6 +423,10 @@ struct VerilogFrontend : public Frontend {
 				flag_nopp = true;
 				continue;
 			}
+			if (arg == "-threads" && argidx+1 < args.size()) {
+				preproc_threads = parallel_thread_count(atoi(args[++argidx].c_str()));
+				continue;
+			}
 			if (arg == "-nodpi") {
 				flag_nodpi = true;
 				continue;
@@ -458,6 +517,18 @@ struct VerilogFrontend : public Frontend {
 
 		extra_args(f, filename, args, argidx);
 
+		// a batch left over from a command that was aborted by an error
+		if (!preproc_pending.empty() && preproc_pending.back() != filename) {
+			preproc_results.clear();
+			preproc_pending.clear();
+		}
+
+		if (!flag_nopp && preproc_threads > 1 && preproc_pending.empty() && !next_args.empty()) {
+			std::vector<std::string> filenames = {filename};
+			filenames.insert(filenames.end(), next_args.begin() + argidx, next_args.end());
+			preprocess_ahead(filenames, defines_map, *design->verilog_defines, include_dirs, preproc_threads);
+		}
+
 		log_header(design, "Executing Verilog-2005 frontend: %s\n", filename.c_str());
 
 		log("Parsing %s%s input from `%s' to AST representation.\n",
@@ -473,7 +544,27 @@ struct VerilogFrontend : public Frontend {
 		std::string code_after_preproc;
 
 		if (!flag_nopp) {
-			code_after_preproc = frontend_verilog_preproc(*f, filename, defines_map, *design->verilog_defines, include_dirs);
+			preproc_usage_t usage;
+			auto it = preproc_results.find(filename);
+			if (it != preproc_results.end() && it->second.ok && frontend_verilog_preproc_commit(it->second.usage,
+					preproc_changed_defines, preproc_defines_reset, it->second.defines_cache, *design->verilog_defines)) {
+				code_after_preproc = std::move(it->second.output);
+				usage = std::move(it->second.usage);
+			} else {
+				if (it != preproc_results.end() && it->second.ok)
+					log("Pre-processing `%s' again, as it uses macros changed by previously read files.\n", filename.c_str());
+				code_after_preproc = frontend_verilog_preproc(*f, filename, defines_map, *design->verilog_defines, include_dirs, &include_cache, &usage);
+			}
+			if (it != preproc_results.end())
+				preproc_results.erase(it);
+			if (!preproc_pending.empty()) {
+				for (auto &name : usage.changed_defines)
+					preproc_changed_defines.insert(name);
+				preproc_defines_reset |= usage.reset_defines;
+				preproc_pending.pop_back();
+				if (preproc_pending.empty())
+					preproc_results.clear();
+			}
 			if (flag_ppdump)
 				log("-- Verilog code after preprocessor --\n%s-- END OF DUMP --\n", code_after_preproc.c_str());
 			lexin = new std::istringstream(code_after_preproc);
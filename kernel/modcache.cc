@@ -0,0 +1,138 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/modcache.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+namespace {
+
+// Const::hash() and dict::hash() are only good enough for hash tables, so constants and
+// dictionaries are hashed here with every bit and with keys and values paired up.
+
+unsigned int hash_const(const RTLIL::Const &value)
+{
+	unsigned int h = mkhash(mkhash_init, value.flags);
+	for (auto bit : value.bits)
+		h = mkhash(h, bit);
+	return h;
+}
+
+unsigned int hash_sig(const RTLIL::SigSpec &sig)
+{
+	return mkhash(sig.hash(), GetSize(sig));
+}
+
+unsigned int hash_consts(const dict<RTLIL::IdString, RTLIL::Const> &values)
+{
+	unsigned int h = mkhash_init;
+	for (auto &it : values)
+		h ^= mkhash_xorshift(mkhash(it.first.hash(), hash_const(it.second)));
+	return h;
+}
+
+unsigned int hash_sigsig(const RTLIL::SigSig &conn)
+{
+	return mkhash(hash_sig(conn.first), hash_sig(conn.second));
+}
+
+unsigned int hash_case(const RTLIL::CaseRule *case_);
+
+unsigned int hash_switch(const RTLIL::SwitchRule *switch_)
+{
+	unsigned int h = mkhash(hash_consts(switch_->attributes), hash_sig(switch_->signal));
+	for (auto case_ : switch_->cases)
+		h = mkhash(h, hash_case(case_));
+	return h;
+}
+
+unsigned int hash_case(const RTLIL::CaseRule *case_)
+{
+	unsigned int h = hash_consts(case_->attributes);
+	for (auto &compare : case_->compare)
+		h = mkhash(h, hash_sig(compare));
+	for (auto &action : case_->actions)
+		h = mkhash(h, hash_sigsig(action));
+	for (auto switch_ : case_->switches)
+		h = mkhash(h, hash_switch(switch_));
+	return h;
+}
+
+unsigned int hash_process(const RTLIL::Process *process)
+{
+	unsigned int h = mkhash(process->name.hash(), hash_consts(process->attributes));
+	h = mkhash(h, hash_case(&process->root_case));
+	for (auto sync : process->syncs) {
+		h = mkhash(h, mkhash(sync->type, hash_sig(sync->signal)));
+		for (auto &action : sync->actions)
+			h = mkhash(h, hash_sigsig(action));
+		for (auto &mem_write : sync->mem_write_actions) {
+			h = mkhash(h, mkhash(mem_write.memid.hash(), hash_consts(mem_write.attributes)));
+			h = mkhash(h, mkhash(hash_sig(mem_write.address), hash_sig(mem_write.data)));
+			h = mkhash(h, mkhash(hash_sig(mem_write.enable), hash_const(mem_write.priority_mask)));
+		}
+	}
+	return h;
+}
+
+} // namespace
+
+unsigned int module_fingerprint(const RTLIL::Module *module)
+{
+	unsigned int h = mkhash(module->name.hash(), hash_consts(module->attributes));
+	for (auto &param : module->avail_parameters)
+		h = mkhash(h, param.hash());
+	h = mkhash(h, hash_consts(module->parameter_default_values));
+	for (auto &port : module->ports)
+		h = mkhash(h, port.hash());
+	for (auto &conn : module->connections())
+		h = mkhash(h, hash_sigsig(conn));
+
+	// Objects are combined with xor, so that the order of creation does not matter.
+	unsigned int wires_h = 0, cells_h = 0, memories_h = 0, processes_h = 0;
+	for (auto &it : module->wires_) {
+		const RTLIL::Wire *wire = it.second;
+		unsigned int wire_h = mkhash(wire->name.hash(), hash_consts(wire->attributes));
+		wire_h = mkhash(wire_h, mkhash(wire->width, wire->start_offset));
+		wire_h = mkhash(wire_h, mkhash(wire->port_id, (wire->port_input ? 1 : 0) | (wire->port_output ? 2 : 0) |
+				(wire->upto ? 4 : 0) | (wire->is_signed ? 8 : 0)));
+		wires_h ^= mkhash_xorshift(wire_h);
+	}
+	for (auto &it : module->cells_) {
+		const RTLIL::Cell *cell = it.second;
+		unsigned int cell_h = mkhash(mkhash(cell->name.hash(), cell->type.hash()), hash_consts(cell->attributes));
+		cell_h = mkhash(cell_h, hash_consts(cell->parameters));
+		unsigned int ports_h = 0;
+		for (auto &conn : cell->connections())
+			ports_h ^= mkhash_xorshift(mkhash(conn.first.hash(), hash_sig(conn.second)));
+		cells_h ^= mkhash_xorshift(mkhash(cell_h, ports_h));
+	}
+	for (auto &it : module->memories) {
+		const RTLIL::Memory *memory = it.second;
+		unsigned int memory_h = mkhash(memory->name.hash(), hash_consts(memory->attributes));
+		memory_h = mkhash(memory_h, mkhash(memory->width, mkhash(memory->start_offset, memory->size)));
+		memories_h ^= mkhash_xorshift(memory_h);
+	}
+	for (auto &it : module->processes)
+		processes_h ^= mkhash_xorshift(hash_process(it.second));
+
+	return mkhash(h, mkhash(mkhash(wires_h, cells_h), mkhash(memories_h, processes_h)));
+}
+
+YOSYS_NAMESPACE_END
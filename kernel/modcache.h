@@ -0,0 +1,84 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#ifndef MODCACHE_H
+#define MODCACHE_H
+
+#include "kernel/yosys.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+// Returns a hash of everything in a module: its attributes, parameters, ports, wires, cells
+// (including parameters and connections), connections, memories and processes. The hash does not
+// depend on the order in which wires, cells, memories and processes have been created.
+unsigned int module_fingerprint(const RTLIL::Module *module);
+
+// Remembers a result per module for as long as the module is not changed. Changes are detected by
+// comparing module fingerprints, so changes made by any pass in between are seen without observing
+// the design through a monitor. The options string should hold everything else the result depends on.
+template<typename T>
+struct ModuleCache
+{
+	struct entry_t {
+		std::string options;
+		unsigned int fingerprint;
+		T result;
+	};
+
+	// indexed by the hashidx_ of the modules, which is unique for each module object
+	dict<int, entry_t> entries;
+
+	// Returns the result remembered for the module, or nullptr if the module has been changed since.
+	const T *lookup(const RTLIL::Module *module, const std::string &options)
+	{
+		auto it = entries.find(module->hashidx_);
+		if (it == entries.end())
+			return nullptr;
+		if (it->second.options == options && it->second.fingerprint == module_fingerprint(module))
+			return &it->second.result;
+		entries.erase(it);
+		return nullptr;
+	}
+
+	void insert(const RTLIL::Module *module, const std::string &options, const T &result)
+	{
+		entry_t &entry = entries[module->hashidx_];
+		entry.options = options;
+		entry.fingerprint = module_fingerprint(module);
+		entry.result = result;
+	}
+
+	// Forgets the modules that are not in the design, e.g. because they have been deleted.
+	void prune(const RTLIL::Design *design)
+	{
+		pool<int> live;
+		for (auto &it : design->modules_)
+			live.insert(it.second->hashidx_);
+		std::vector<int> dead;
+		for (auto &it : entries)
+			if (!live.count(it.first))
+				dead.push_back(it.first);
+		for (auto hashidx : dead)
+			entries.erase(hashidx);
+	}
+};
+
+YOSYS_NAMESPACE_END
+
+#endif
@@ -0,0 +1,426 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/passcache.h"
+#include "backends/rtlil/rtlil_backend.h"
+#include "libs/sha1/sha1.h"
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#  include <direct.h>
+#endif
+
+YOSYS_NAMESPACE_BEGIN
+
+namespace {
+
+struct PassCacheState
+{
+	std::string dir;
+	pool<std::string> passes;
+	bool env_checked = false;
+	bool active = false;
+	int hits = 0, misses = 0, stored = 0;
+};
+
+PassCacheState cache_state;
+
+// The passes supported by the cache, with the options of each pass that take a value. Any other
+// argument not starting with '-' is an explicit selection (or an option value we do not know about,
+// such as the label range of 'abc9 -run'), and causes the cache to be bypassed for that command.
+const dict<std::string, pool<std::string>> &cacheable_passes()
+{
+	static const dict<std::string, pool<std::string>> passes = {
+		{ "abc", { "-exe", "-script", "-liberty", "-constr", "-D", "-I", "-P", "-S", "-lut", "-luts", "-g", "-clk" } },
+		{ "abc9", { "-exe", "-script", "-D", "-W", "-S", "-lut", "-luts", "-maxlut", "-box" } },
+		{ "memory_bram", { "-rules" } },
+		{ "opt", { } },
+		{ "techmap", { "-map", "-D", "-I", "-max_iter" } },
+	};
+	return passes;
+}
+
+bool create_cache_dir(const std::string &dir)
+{
+	struct stat st;
+	if (stat(dir.c_str(), &st) == 0)
+		return (st.st_mode & S_IFDIR) != 0;
+#ifdef _WIN32
+	return _mkdir(dir.c_str()) == 0;
+#else
+	return mkdir(dir.c_str(), 0777) == 0;
+#endif
+}
+
+void check_env()
+{
+	if (cache_state.env_checked)
+		return;
+	cache_state.env_checked = true;
+
+	const char *env_dir = getenv("YOSYS_PASS_CACHE");
+	if (env_dir != nullptr && *env_dir != 0 && cache_state.dir.empty()) {
+		if (!create_cache_dir(env_dir))
+			log_error("Can't create pass cache directory `%s' (from YOSYS_PASS_CACHE).\n", env_dir);
+		cache_state.dir = env_dir;
+	}
+}
+
+// Everything a module-local pass may depend on besides the module itself: the command line, the contents
+// of files named on it, the scratchpad options of the pass and the Yosys version. Returns false if the command can't be cached.
+bool hash_command(RTLIL::Design *design, const std::vector<std::string> &args, std::string &hash_data)
+{
+	const pool<std::string> &value_options = cacheable_passes().at(args[0]);
+
+	hash_data = stringf("%s\n%s\n", yosys_version_str, args[0].c_str());
+	for (size_t argidx = 1; argidx < args.size(); argidx++) {
+		const std::string &arg = args[argidx];
+		if (arg.compare(0, 1, "-") != 0)
+			return false;
+		hash_data += stringf("%s\n", arg.c_str());
+		if (!value_options.count(arg) || argidx+1 >= args.size())
+			continue;
+
+		std::string value = args[++argidx];
+		// maps taken from the design ('techmap -map %name') are not covered by the hash
+		if (value.compare(0, 1, "%") == 0)
+			return false;
+		hash_data += stringf("%s\n", value.c_str());
+
+		std::string filename = value;
+		rewrite_filename(filename);
+		if (!check_file_exists(filename))
+			continue;
+		std::ifstream f(filename, std::ios::binary);
+		std::string content((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+		hash_data += stringf("file %d %s\n", GetSize(content), sha1(content).c_str());
+	}
+
+	// options in the scratchpad are named after the pass, "*.did_something" flags are state, not input
+	std::map<std::string, std::string> scratchpad;
+	for (auto &it : design->scratchpad)
+		if (it.first.compare(0, args[0].size() + 1, args[0] + ".") == 0 && it.first.find(".did_something") == std::string::npos)
+			scratchpad[it.first] = it.second;
+	for (auto &it : scratchpad)
+		hash_data += stringf("scratchpad %s %s\n", it.first.c_str(), it.second.c_str());
+	return true;
+}
+
+// Boxes are hashed in full, as passes such as abc9 use their contents; for other instantiated
+// modules only the interface is relevant to a module-local pass.
+std::string hash_module(RTLIL::Design *design, RTLIL::Module *module, const std::string &command_data)
+{
+	std::stringstream buf;
+	buf << command_data;
+
+	pool<RTLIL::IdString> submodules;
+	for (auto cell : module->cells())
+		if (design->module(cell->type) != nullptr)
+			submodules.insert(cell->type);
+	submodules.sort(RTLIL::sort_by_id_str());
+
+	for (auto &type : submodules) {
+		RTLIL::Module *submodule = design->module(type);
+		if (submodule->get_blackbox_attribute()) {
+			RTLIL_BACKEND::dump_module(buf, "", submodule, design, false);
+			continue;
+		}
+		buf << stringf("interface %s\n", log_id(type));
+		std::map<std::string, RTLIL::Const> attributes;
+		for (auto &attr : submodule->attributes)
+			attributes[attr.first.str()] = attr.second;
+		for (auto &attr : attributes)
+			buf << stringf("  attribute %s %s\n", attr.first.c_str(), attr.second.as_string().c_str());
+		for (auto port : submodule->ports) {
+			RTLIL::Wire *wire = submodule->wire(port);
+			buf << stringf("  port %s %d %d %d %d %d %d\n", log_id(port), wire->width, wire->start_offset,
+					wire->upto, wire->is_signed, wire->port_input, wire->port_output);
+		}
+		for (auto &param : submodule->avail_parameters)
+			buf << stringf("  parameter %s\n", log_id(param));
+	}
+
+	buf << PassCache::canonical_text(module);
+	return sha1(buf.str());
+}
+
+void store_module(RTLIL::Design *design, RTLIL::Module *module, const std::string &path)
+{
+	std::string tmp_path = make_temp_file(cache_state.dir + "/.tmp_XXXXXX");
+	{
+		std::ofstream f(tmp_path);
+		// The RTLIL backend writes objects in reverse order of creation, and the frontend creates them in
+		// the order they are read. Writing a clone (which is created in reverse order) instead means that
+		// a module taken from the cache has the same object order as the one produced by the pass, so
+		// that later passes make the same choices in both cases.
+		RTLIL::Module *ordered = module->clone();
+		f << stringf("autoidx %d\n", autoidx);
+		RTLIL_BACKEND::dump_module(f, "", ordered, design, false);
+		delete ordered;
+		if (f.fail()) {
+			log_warning("Failed to write pass cache entry `%s'.\n", tmp_path.c_str());
+			remove(tmp_path.c_str());
+			return;
+		}
+	}
+	// renaming makes the new entry visible atomically to concurrent Yosys processes
+	if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+		remove(tmp_path.c_str());
+		return;
+	}
+	cache_state.stored++;
+}
+
+struct ActiveGuard
+{
+	ActiveGuard() { cache_state.active = true; }
+	~ActiveGuard() { cache_state.active = false; }
+};
+
+} // namespace
+
+// Private names usually contain autoidx values, which differ between a run that executes all passes
+// and one that takes some results from the cache. They are numbered in order of creation for hashing,
+// so that such modules still find each other's results. The order of parameters, connections and
+// attributes is not preserved by the cache, so the module is sorted before it is dumped.
+std::string PassCache::canonical_text(RTLIL::Module *module)
+{
+	RTLIL::Module *canonical = module->clone();
+	std::vector<RTLIL::Wire*> private_wires;
+	std::vector<RTLIL::Cell*> private_cells;
+	for (auto wire : canonical->wires())
+		if (wire->name[0] == '$')
+			private_wires.push_back(wire);
+	for (auto cell : canonical->cells())
+		if (cell->name[0] == '$')
+			private_cells.push_back(cell);
+	int index = 0;
+	for (auto wire : private_wires)
+		canonical->rename(wire, stringf("$passcache$%d", index++));
+	for (auto cell : private_cells)
+		canonical->rename(cell, stringf("$passcache$%d", index++));
+	canonical->attributes.erase(ID::checkpoint_hash);
+	canonical->sort();
+	canonical->attributes.sort(RTLIL::sort_by_id_str());
+
+	std::stringstream buf;
+	RTLIL_BACKEND::dump_module(buf, "", canonical, module->design, false);
+	delete canonical;
+	return buf.str();
+}
+
+bool PassCache::call(RTLIL::Design *design, const std::vector<std::string> &args)
+{
+	check_env();
+
+	// nested commands (e.g. the passes called by 'opt') are covered by the outermost cached command
+	if (cache_state.dir.empty() || cache_state.active)
+		return false;
+	if (!cacheable_passes().count(args[0]) || (!cache_state.passes.empty() && !cache_state.passes.count(args[0])))
+		return false;
+	if (!design->selected_active_module.empty())
+		return false;
+
+	std::string command_data;
+	if (!hash_command(design, args, command_data))
+		return false;
+
+	std::vector<std::pair<RTLIL::IdString, std::string>> cacheable;
+	pool<RTLIL::IdString> uncacheable;
+	for (auto module : design->modules()) {
+		if (!design->selected_module(module))
+			continue;
+		if (!design->selected_whole_module(module))
+			return false;
+		if (module->get_blackbox_attribute())
+			uncacheable.insert(module->name);
+		else
+			cacheable.push_back(std::make_pair(module->name, hash_module(design, module, command_data)));
+	}
+
+	std::string command = args[0];
+	for (size_t i = 1; i < args.size(); i++)
+		command += " " + args[i];
+
+	std::stringstream cached_rtlil;
+	pool<RTLIL::IdString> hit_modules;
+	dict<RTLIL::IdString, std::string> miss_paths;
+	for (auto &it : cacheable) {
+		std::string path = stringf("%s/%s.il", cache_state.dir.c_str(), it.second.c_str());
+		std::ifstream f(path);
+		if (f.fail()) {
+			miss_paths[it.first] = path;
+			continue;
+		}
+		cached_rtlil << f.rdbuf();
+		hit_modules.insert(it.first);
+	}
+
+	cache_state.hits += GetSize(hit_modules);
+	cache_state.misses += GetSize(miss_paths);
+
+	log_header(design, "Looking up `%s' in pass cache.\n", command.c_str());
+	log("Found cached results for %d of %d modules.\n", GetSize(hit_modules), GetSize(cacheable));
+
+	if (!hit_modules.empty())
+	{
+		for (auto name : hit_modules)
+			design->remove(design->module(name));
+
+		log_push();
+		Frontend::frontend_call(design, &cached_rtlil, "<pass cache>", "rtlil");
+		log_pop();
+
+		for (auto name : hit_modules)
+			if (design->module(name) == nullptr)
+				log_error("Pass cache entry for module %s is corrupt.\n", log_id(name));
+	}
+
+	if (miss_paths.empty() && uncacheable.empty())
+		return true;
+
+	RTLIL::Selection selection(false);
+	for (auto &it : miss_paths)
+		selection.selected_modules.insert(it.first);
+	for (auto name : uncacheable)
+		selection.selected_modules.insert(name);
+
+	pool<RTLIL::IdString> modules_before;
+	for (auto module : design->modules())
+		modules_before.insert(module->name);
+
+	{
+		ActiveGuard guard;
+		Pass::call_on_selection(design, selection, args);
+	}
+
+	pool<RTLIL::IdString> modules_after;
+	for (auto module : design->modules())
+		modules_after.insert(module->name);
+
+	// results of passes that add or remove modules can't be attributed to individual modules
+	if (!(modules_before == modules_after)) {
+		log("Not caching results of `%s', as it changed the set of modules in the design.\n", command.c_str());
+		return true;
+	}
+
+	for (auto &it : miss_paths)
+		store_module(design, design->module(it.first), it.second);
+	return true;
+}
+
+struct PassCachePass : public Pass {
+	PassCachePass() : Pass("passcache", "configure the on-disk pass result cache") { }
+	void help() override
+	{
+		//   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
+		log("\n");
+		log("    passcache -dir <directory> [-passes <pass>[,<pass>...]]\n");
+		log("\n");
+		log("Enable caching of the results of expensive module-local passes. Each selected\n");
+		log("module is hashed together with the pass arguments, the contents of files named\n");
+		log("in them, the interfaces of instantiated modules and the Yosys version. Modules\n");
+		log("with a result in the cache are replaced by the cached RTLIL, and the pass is\n");
+		log("only executed on the remaining modules, whose results are then stored in the\n");
+		log("cache directory (which is created if it does not exist).\n");
+		log("\n");
+		log("The following passes are supported: abc, abc9, memory_bram, opt, techmap. With\n");
+		log("-passes, only the given subset of them is cached. Commands with an explicit\n");
+		log("selection, partially selected modules or commands that add or remove modules\n");
+		log("are always executed normally.\n");
+		log("\n");
+		log("Files included by files named on the command line (e.g. a techmap library that\n");
+		log("uses `include) are not part of the hash; clear the cache directory when those\n");
+		log("change.\n");
+		log("\n");
+		log("The cache can also be enabled by setting the YOSYS_PASS_CACHE environment\n");
+		log("variable to the cache directory.\n");
+		log("\n");
+		log("\n");
+		log("    passcache -off\n");
+		log("\n");
+		log("Disable the pass cache.\n");
+		log("\n");
+		log("\n");
+		log("    passcache -stats\n");
+		log("\n");
+		log("Print the number of modules found and not found in the cache, and the number of\n");
+		log("new cache entries written.\n");
+		log("\n");
+	}
+	void execute(std::vector<std::string> args, RTLIL::Design*) override
+	{
+		std::string dir, passes;
+		bool off = false, stats = false;
+
+		size_t argidx;
+		for (argidx = 1; argidx < args.size(); argidx++) {
+			if (args[argidx] == "-dir" && argidx+1 < args.size()) {
+				dir = args[++argidx];
+				continue;
+			}
+			if (args[argidx] == "-passes" && argidx+1 < args.size()) {
+				passes = args[++argidx];
+				continue;
+			}
+			if (args[argidx] == "-off") {
+				off = true;
+				continue;
+			}
+			if (args[argidx] == "-stats") {
+				stats = true;
+				continue;
+			}
+			break;
+		}
+		if (argidx != args.size() || (dir.empty() && !off && !stats) || (!dir.empty() && off))
+			cmd_error(args, argidx, "Invalid combination of arguments.");
+
+		check_env();
+
+		if (off) {
+			cache_state.dir.clear();
+			cache_state.passes.clear();
+		}
+
+		if (!dir.empty()) {
+			rewrite_filename(dir);
+			while (GetSize(dir) > 1 && (dir.back() == '/' || dir.back() == '\\'))
+				dir.pop_back();
+			if (!create_cache_dir(dir))
+				log_cmd_error("Can't create pass cache directory `%s'.\n", dir.c_str());
+			cache_state.dir = dir;
+			cache_state.passes.clear();
+			for (auto &name : split_tokens(passes, ",")) {
+				if (!cacheable_passes().count(name))
+					log_cmd_error("Pass `%s' is not supported by the pass cache.\n", name.c_str());
+				cache_state.passes.insert(name);
+			}
+		}
+
+		if (stats) {
+			log("Pass cache: %s\n", cache_state.dir.empty() ? "disabled" : cache_state.dir.c_str());
+			log("  modules found in cache:     %d\n", cache_state.hits);
+			log("  modules not found in cache: %d\n", cache_state.misses);
+			log("  new cache entries written:  %d\n", cache_state.stored);
+		}
+	}
+} PassCachePass;
+
+YOSYS_NAMESPACE_END
@@ -0,0 +1,47 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#ifndef PASSCACHE_H
+#define PASSCACHE_H
+
+#include "kernel/yosys.h"
+
+YOSYS_NAMESPACE_BEGIN
+
+// An on-disk cache for the results of module-local passes (see 'help passcache').
+//
+// Each selected module is hashed together with the pass arguments, the contents of any files named
+// in the arguments, the interfaces of the modules it instantiates and the Yosys version. Modules with
+// a cached result are replaced by the cached post-pass RTLIL, and the pass is only executed on the
+// remaining modules, whose results are then added to the cache.
+struct PassCache
+{
+	// Called from Pass::call(). Returns true if the command has been handled (possibly by running
+	// the pass on a subset of the design), false if the command should be executed as usual.
+	static bool call(RTLIL::Design *design, const std::vector<std::string> &args);
+
+	// Returns the RTLIL text of a module with private names numbered in order of creation and with
+	// all objects sorted, i.e. a text that is stable when the module is written and read back, or
+	// when it is created again after a different number of autoidx values have been used up.
+	static std::string canonical_text(RTLIL::Module *module);
+};
+
+YOSYS_NAMESPACE_END
+
+#endif
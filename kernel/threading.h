@@ -0,0 +1,83 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#ifndef THREADING_H
+#define THREADING_H
+
+#include "kernel/yosys.h"
+
+#ifndef YOSYS_DISABLE_THREADS
+#  include <atomic>
+#  include <thread>
+#endif
+
+YOSYS_NAMESPACE_BEGIN
+
+// Helpers for running independent jobs on worker threads.
+//
+// Most of the Yosys kernel is not thread-safe: IdStrings are reference counted through a global table,
+// and creating, renaming or removing RTLIL objects updates global and per-module state. A job running
+// on a worker thread must therefore only read the design, must not create or copy IdStrings (use const
+// references and c_str() instead), and must not call any of the log functions. Results are collected in
+// per-job buffers and committed to the design on the main thread afterwards.
+
+// Returns the number of threads to use for a -threads <n> option, where n <= 0 means "one per core".
+static inline int parallel_thread_count(int requested)
+{
+#ifdef YOSYS_DISABLE_THREADS
+	(void)requested;
+	return 1;
+#else
+	if (requested <= 0)
+		requested = std::thread::hardware_concurrency();
+	return std::max(requested, 1);
+#endif
+}
+
+// Calls job(i) for each i in [0, count), distributing the calls over the given number of threads,
+// including the calling thread. Returns once all calls have completed.
+template<typename F>
+void parallel_for(int threads, int count, F job)
+{
+#ifndef YOSYS_DISABLE_THREADS
+	threads = std::min(threads, count);
+	if (threads > 1) {
+		std::atomic<int> next_index(0);
+		auto worker = [&]() {
+			for (int i = next_index++; i < count; i = next_index++)
+				job(i);
+		};
+		std::vector<std::thread> workers;
+		for (int i = 1; i < threads; i++)
+			workers.emplace_back(worker);
+		worker();
+		for (auto &thread : workers)
+			thread.join();
+		return;
+	}
+#else
+	(void)threads;
+#endif
+	for (int i = 0; i < count; i++)
+		job(i);
+}
+
+YOSYS_NAMESPACE_END
+
+#endif
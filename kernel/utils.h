@@ -209,6 +209,115 @@ struct TopoSort
 	}
 };
 
+// ------------------------------------------------
+// Strongly connected components of a graph with integer nodes
+// ------------------------------------------------
+
+// The graph is stored as a compressed sparse row (CSR) adjacency array: the
+// successors of node i are targets[offsets[i]] .. targets[offsets[i+1]-1].
+// The components are found with an iterative version of Tarjan's algorithm,
+// so that long paths can not overflow the stack.
+struct SccGraph
+{
+	std::vector<int> offsets, targets;
+
+	// The nodes of component i are component_nodes[component_offsets[i]] ..
+	// component_nodes[component_offsets[i+1]-1], in the order in which they are
+	// popped off the Tarjan stack. Components are numbered in the order in which
+	// they are completed, i.e. successors come before their predecessors.
+	std::vector<int> component_offsets, component_nodes;
+
+	// Builds the adjacency array from an edge list. The successors of each node
+	// are kept in the order in which the edges are given.
+	SccGraph(int nodes, const std::vector<std::pair<int, int>> &edges)
+	{
+		offsets.assign(nodes+1, 0);
+		for (auto &edge : edges)
+			offsets[edge.first+1]++;
+		for (int i = 0; i < nodes; i++)
+			offsets[i+1] += offsets[i];
+
+		std::vector<int> fill(offsets.begin(), offsets.end()-1);
+		targets.resize(GetSize(edges));
+		for (auto &edge : edges)
+			targets[fill[edge.first]++] = edge.second;
+	}
+
+	int nodes() const { return GetSize(offsets)-1; }
+	int components() const { return GetSize(component_offsets)-1; }
+	int component_size(int i) const { return component_offsets[i+1] - component_offsets[i]; }
+
+	// Visits the nodes in ascending order, starting a new depth first search from
+	// each node that has not been reached yet. With max_depth >= 0 a back edge only
+	// merges components if its target is less than max_depth steps above its source
+	// on the search path, which limits the search to short loops (as 'scc -max_depth'
+	// does). Returns the number of components found.
+	int find(int max_depth = -1)
+	{
+		int n = nodes();
+		std::vector<int> index(n, -1), lowlink(n), depth(n);
+		std::vector<bool> on_stack(n);
+		std::vector<int> stack;
+		std::vector<std::pair<int, int>> path;
+		int counter = 0;
+
+		component_offsets.assign(1, 0);
+		component_nodes.clear();
+
+		for (int root = 0; root < n; root++)
+		{
+			if (index[root] >= 0)
+				continue;
+
+			index[root] = lowlink[root] = counter++;
+			depth[root] = 0;
+			on_stack[root] = true;
+			stack.push_back(root);
+			path.push_back(std::make_pair(root, offsets[root]));
+
+			while (!path.empty())
+			{
+				int node = path.back().first;
+
+				if (path.back().second < offsets[node+1])
+				{
+					int next = targets[path.back().second++];
+					if (index[next] < 0) {
+						index[next] = lowlink[next] = counter++;
+						depth[next] = depth[node]+1;
+						on_stack[next] = true;
+						stack.push_back(next);
+						path.push_back(std::make_pair(next, offsets[next]));
+					} else
+					if (on_stack[next] && (max_depth < 0 || depth[next] + max_depth > depth[node]))
+						lowlink[node] = std::min(lowlink[node], lowlink[next]);
+					continue;
+				}
+
+				path.pop_back();
+
+				if (lowlink[node] == index[node]) {
+					int popped;
+					do {
+						popped = stack.back();
+						stack.pop_back();
+						on_stack[popped] = false;
+						component_nodes.push_back(popped);
+					} while (popped != node);
+					component_offsets.push_back(GetSize(component_nodes));
+				}
+
+				if (!path.empty()) {
+					int parent = path.back().first;
+					lowlink[parent] = std::min(lowlink[parent], lowlink[node]);
+				}
+			}
+		}
+
+		return components();
+	}
+};
+
 YOSYS_NAMESPACE_END
 
 #endif
@@ -21,11 +21,233 @@
 #include "kernel/sigtools.h"
 #include "kernel/celltypes.h"
 #include "kernel/utils.h"
+#include "kernel/modcache.h"
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
 
+// The result of checking a module also depends on the modules it instantiates: their port directions
+// and, for -mapped, whether a cell type is a module at all.
+static std::string instantiated_interfaces(Module *module)
+{
+	unsigned int types_h = mkhash_init;
+	pool<IdString> types;
+	for (auto cell : module->cells())
+		types.insert(cell->type);
+	for (auto type : types) {
+		Module *mod = module->design->module(type);
+		unsigned int h = mkhash(type.hash(), mod != nullptr);
+		if (mod != nullptr)
+			for (auto port : mod->ports) {
+				Wire *wire = mod->wire(port);
+				h = mkhash(h, mkhash(port.hash(), (wire->port_input ? 1 : 0) + (wire->port_output ? 2 : 0)));
+			}
+		types_h ^= h;
+	}
+	return stringf("%08x", types_h);
+}
+
+struct CheckWorker
+{
+	RTLIL::Design *design;
+	bool noinit, initdrv, mapped, allow_tbuf;
+	std::vector<std::string> problems;
+
+	CheckWorker(RTLIL::Design *design) : design(design), noinit(false), initdrv(false), mapped(false), allow_tbuf(false) { }
+
+	void check(RTLIL::Module *module)
+	{
+		SigMap sigmap(module);
+		dict<SigBit, vector<string>> wire_drivers;
+		dict<SigBit, int> wire_drivers_count;
+		pool<SigBit> used_wires;
+
+		// Logic loops are found as the strongly connected components of a graph
+		// with a node for each logic cell and for each signal bit connected to one.
+		std::vector<std::pair<Cell*, SigBit>> loop_nodes;
+		dict<SigBit, int> loop_bit_nodes;
+		std::vector<std::pair<int, int>> loop_edges;
+
+		auto loop_bit_node = [&](SigBit bit) {
+			auto it = loop_bit_nodes.find(bit);
+			if (it != loop_bit_nodes.end())
+				return it->second;
+			int node = GetSize(loop_nodes);
+			loop_nodes.push_back(std::make_pair(nullptr, bit));
+			loop_bit_nodes[bit] = node;
+			return node;
+		};
+
+		for (auto &proc_it : module->processes)
+		{
+			std::vector<RTLIL::CaseRule*> all_cases = {&proc_it.second->root_case};
+			for (size_t i = 0; i < all_cases.size(); i++) {
+				for (auto action : all_cases[i]->actions) {
+					for (auto bit : sigmap(action.first))
+						if (bit.wire) {
+							wire_drivers[bit].push_back(
+								stringf("action %s <= %s (case rule) in process %s",
+								        log_signal(action.first), log_signal(action.second), log_id(proc_it.first)));
+						}
+					for (auto bit : sigmap(action.second))
+						if (bit.wire) used_wires.insert(bit);
+				}
+				for (auto switch_ : all_cases[i]->switches) {
+					for (auto case_ : switch_->cases) {
+						all_cases.push_back(case_);
+						for (auto compare : case_->compare)
+							for (auto bit : sigmap(compare))
+								if (bit.wire) used_wires.insert(bit);
+					}
+				}
+			}
+			for (auto &sync : proc_it.second->syncs) {
+				for (auto bit : sigmap(sync->signal))
+					if (bit.wire) used_wires.insert(bit);
+				for (auto action : sync->actions) {
+					for (auto bit : sigmap(action.first))
+						if (bit.wire)
+							wire_drivers[bit].push_back(
+								stringf("action %s <= %s (sync rule) in process %s",
+								        log_signal(action.first), log_signal(action.second), log_id(proc_it.first)));
+					for (auto bit : sigmap(action.second))
+						if (bit.wire) used_wires.insert(bit);
+				}
+				for (auto memwr : sync->mem_write_actions) {
+					for (auto bit : sigmap(memwr.address))
+						if (bit.wire) used_wires.insert(bit);
+					for (auto bit : sigmap(memwr.data))
+						if (bit.wire) used_wires.insert(bit);
+					for (auto bit : sigmap(memwr.enable))
+						if (bit.wire) used_wires.insert(bit);
+				}
+			}
+		}
+
+		for (auto cell : module->cells())
+		{
+			if (mapped && cell->type.begins_with("$") && design->module(cell->type) == nullptr) {
+				if (allow_tbuf && cell->type == ID($_TBUF_)) goto cell_allowed;
+				problems.push_back(stringf("Cell %s.%s is an unmapped internal cell of type %s.\n", log_id(module), log_id(cell), log_id(cell->type)));
+			cell_allowed:;
+			}
+			int cell_node = -1;
+			if (yosys_celltypes.cell_evaluable(cell->type)) {
+				cell_node = GetSize(loop_nodes);
+				loop_nodes.push_back(std::make_pair(cell, State::Sx));
+			}
+			for (auto &conn : cell->connections()) {
+				SigSpec sig = sigmap(conn.second);
+				if (cell->input(conn.first))
+					for (auto bit : sig)
+						if (bit.wire) {
+							if (cell_node >= 0)
+								loop_edges.push_back(std::make_pair(loop_bit_node(bit), cell_node));
+							used_wires.insert(bit);
+						}
+				if (cell->output(conn.first))
+					for (int i = 0; i < GetSize(sig); i++) {
+						if (sig[i].wire) {
+							if (cell_node >= 0)
+								loop_edges.push_back(std::make_pair(cell_node, loop_bit_node(sig[i])));
+							wire_drivers[sig[i]].push_back(stringf("port %s[%d] of cell %s (%s)",
+									log_id(conn.first), i, log_id(cell), log_id(cell->type)));
+						}
+					}
+				if (!cell->input(conn.first) && cell->output(conn.first))
+					for (auto bit : sig)
+						if (bit.wire) wire_drivers_count[bit]++;
+			}
+		}
+
+		pool<SigBit> init_bits;
+
+		for (auto wire : module->wires()) {
+			if (wire->port_input) {
+				SigSpec sig = sigmap(wire);
+				for (int i = 0; i < GetSize(sig); i++)
+					wire_drivers[sig[i]].push_back(stringf("module input %s[%d]", log_id(wire), i));
+			}
+			if (wire->port_output)
+				for (auto bit : sigmap(wire))
+					if (bit.wire) used_wires.insert(bit);
+			if (wire->port_input && !wire->port_output)
+				for (auto bit : sigmap(wire))
+					if (bit.wire) wire_drivers_count[bit]++;
+			if (wire->attributes.count(ID::init)) {
+				Const initval = wire->attributes.at(ID::init);
+				for (int i = 0; i < GetSize(initval) && i < GetSize(wire); i++)
+					if (initval[i] == State::S0 || initval[i] == State::S1)
+						init_bits.insert(sigmap(SigBit(wire, i)));
+				if (noinit)
+					problems.push_back(stringf("Wire %s.%s has an unprocessed 'init' attribute.\n", log_id(module), log_id(wire)));
+			}
+		}
+
+		for (auto it : wire_drivers)
+			if (wire_drivers_count[it.first] > 1) {
+				string message = stringf("multiple conflicting drivers for %s.%s:\n", log_id(module), log_signal(it.first));
+				for (auto str : it.second)
+					message += stringf("    %s\n", str.c_str());
+				problems.push_back(message);
+			}
+
+		for (auto bit : used_wires)
+			if (!wire_drivers.count(bit))
+				problems.push_back(stringf("Wire %s.%s is used but has no driver.\n", log_id(module), log_signal(bit)));
+
+		// The node names are only created for the nodes on a loop. Every component
+		// with more than one node is a loop, as there are no edges from a node to
+		// itself in this graph.
+		SccGraph loop_graph(GetSize(loop_nodes), loop_edges);
+		loop_graph.find();
+
+		std::set<std::set<string>> loops;
+		for (int i = 0; i < loop_graph.components(); i++) {
+			if (loop_graph.component_size(i) < 2)
+				continue;
+			std::set<string> loop;
+			for (int j = loop_graph.component_offsets[i]; j < loop_graph.component_offsets[i+1]; j++) {
+				auto &node = loop_nodes[loop_graph.component_nodes[j]];
+				if (node.first != nullptr)
+					loop.insert(stringf("cell %s (%s)", log_id(node.first), log_id(node.first->type)));
+				else
+					loop.insert(stringf("wire %s", log_signal(node.second)));
+			}
+			loops.insert(loop);
+		}
+
+		for (auto &loop : loops) {
+			string message = stringf("found logic loop in module %s:\n", log_id(module));
+			for (auto &str : loop)
+				message += stringf("    %s\n", str.c_str());
+			problems.push_back(message);
+		}
+
+		if (initdrv)
+		{
+			for (auto cell : module->cells())
+			{
+				if (RTLIL::builtin_ff_cell_types().count(cell->type) == 0)
+					continue;
+
+				for (auto bit : sigmap(cell->getPort(ID::Q)))
+					init_bits.erase(bit);
+			}
+
+			SigSpec init_sig(init_bits);
+			init_sig.sort_and_unify();
+
+			for (auto chunk : init_sig.chunks())
+				problems.push_back(stringf("Wire %s.%s has 'init' attribute and is not driven by an FF cell.\n", log_id(module), log_signal(chunk)));
+		}
+	}
+};
+
 struct CheckPass : public Pass {
+	// The problems found in each module, see kernel/modcache.h.
+	ModuleCache<std::vector<std::string>> cache;
+
 	CheckPass() : Pass("check", "check for obvious problems in the design") { }
 	void help() override
 	{
@@ -39,6 +261,8 @@ struct CheckPass : public Pass {
 		log("  - two or more conflicting drivers for one wire\n");
 		log("  - used wires that do not have a driver\n");
 		log("\n");
+		log("Each strongly connected component of logic cells is reported as one loop.\n");
+		log("\n");
 		log("Options:\n");
 		log("\n");
 		log("    -noinit\n");
@@ -58,32 +282,33 @@ struct CheckPass : public Pass {
 		log("    -assert\n");
 		log("        produce a runtime error if any problems are found in the current design\n");
 		log("\n");
+		log("The problems found in a module are remembered. Modules without processes\n");
+		log("that have not been changed since they were last checked with the same\n");
+		log("options are not checked again, the remembered problems are reported instead.\n");
+		log("\n");
 	}
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
 	{
+		CheckWorker worker(design);
 		int counter = 0;
-		bool noinit = false;
-		bool initdrv = false;
-		bool mapped = false;
-		bool allow_tbuf = false;
 		bool assert_mode = false;
 
 		size_t argidx;
 		for (argidx = 1; argidx < args.size(); argidx++) {
 			if (args[argidx] == "-noinit") {
-				noinit = true;
+				worker.noinit = true;
 				continue;
 			}
 			if (args[argidx] == "-initdrv") {
-				initdrv = true;
+				worker.initdrv = true;
 				continue;
 			}
 			if (args[argidx] == "-mapped") {
-				mapped = true;
+				worker.mapped = true;
 				continue;
 			}
 			if (args[argidx] == "-allow-tbuf") {
-				allow_tbuf = true;
+				worker.allow_tbuf = true;
 				continue;
 			}
 			if (args[argidx] == "-assert") {
@@ -96,165 +321,28 @@ struct CheckPass : public Pass {
 
 		log_header(design, "Executing CHECK pass (checking for obvious problems).\n");
 
+		std::string options = stringf("%d%d%d%d", worker.noinit, worker.initdrv, worker.mapped, worker.allow_tbuf);
+		cache.prune(design);
+
 		for (auto module : design->selected_whole_modules_warn())
 		{
 			log("Checking module %s...\n", log_id(module));
 
-			SigMap sigmap(module);
-			dict<SigBit, vector<string>> wire_drivers;
-			dict<SigBit, int> wire_drivers_count;
-			pool<SigBit> used_wires;
-			TopoSort<string> topo;
-
-			for (auto &proc_it : module->processes)
-			{
-				std::vector<RTLIL::CaseRule*> all_cases = {&proc_it.second->root_case};
-				for (size_t i = 0; i < all_cases.size(); i++) {
-					for (auto action : all_cases[i]->actions) {
-						for (auto bit : sigmap(action.first))
-							if (bit.wire) {
-								wire_drivers[bit].push_back(
-									stringf("action %s <= %s (case rule) in process %s",
-									        log_signal(action.first), log_signal(action.second), log_id(proc_it.first)));
-							}
-						for (auto bit : sigmap(action.second))
-							if (bit.wire) used_wires.insert(bit);
-					}
-					for (auto switch_ : all_cases[i]->switches) {
-						for (auto case_ : switch_->cases) {
-							all_cases.push_back(case_);
-							for (auto compare : case_->compare)
-								for (auto bit : sigmap(compare))
-									if (bit.wire) used_wires.insert(bit);
-						}
-					}
-				}
-				for (auto &sync : proc_it.second->syncs) {
-					for (auto bit : sigmap(sync->signal))
-						if (bit.wire) used_wires.insert(bit);
-					for (auto action : sync->actions) {
-						for (auto bit : sigmap(action.first))
-							if (bit.wire)
-								wire_drivers[bit].push_back(
-									stringf("action %s <= %s (sync rule) in process %s",
-									        log_signal(action.first), log_signal(action.second), log_id(proc_it.first)));
-						for (auto bit : sigmap(action.second))
-							if (bit.wire) used_wires.insert(bit);
-					}
-					for (auto memwr : sync->mem_write_actions) {
-						for (auto bit : sigmap(memwr.address))
-							if (bit.wire) used_wires.insert(bit);
-						for (auto bit : sigmap(memwr.data))
-							if (bit.wire) used_wires.insert(bit);
-						for (auto bit : sigmap(memwr.enable))
-							if (bit.wire) used_wires.insert(bit);
-					}
-				}
-			}
-
-			for (auto cell : module->cells())
-			{
-				if (mapped && cell->type.begins_with("$") && design->module(cell->type) == nullptr) {
-					if (allow_tbuf && cell->type == ID($_TBUF_)) goto cell_allowed;
-					log_warning("Cell %s.%s is an unmapped internal cell of type %s.\n", log_id(module), log_id(cell), log_id(cell->type));
-					counter++;
-				cell_allowed:;
-				}
-				for (auto &conn : cell->connections()) {
-					SigSpec sig = sigmap(conn.second);
-					bool logic_cell = yosys_celltypes.cell_evaluable(cell->type);
-					if (cell->input(conn.first))
-						for (auto bit : sig)
-							if (bit.wire) {
-								if (logic_cell)
-									topo.edge(stringf("wire %s", log_signal(bit)),
-											stringf("cell %s (%s)", log_id(cell), log_id(cell->type)));
-								used_wires.insert(bit);
-							}
-					if (cell->output(conn.first))
-						for (int i = 0; i < GetSize(sig); i++) {
-							if (logic_cell)
-								topo.edge(stringf("cell %s (%s)", log_id(cell), log_id(cell->type)),
-										stringf("wire %s", log_signal(sig[i])));
-							if (sig[i].wire)
-								wire_drivers[sig[i]].push_back(stringf("port %s[%d] of cell %s (%s)",
-										log_id(conn.first), i, log_id(cell), log_id(cell->type)));
-						}
-					if (!cell->input(conn.first) && cell->output(conn.first))
-						for (auto bit : sig)
-							if (bit.wire) wire_drivers_count[bit]++;
-				}
-			}
-
-			pool<SigBit> init_bits;
-
-			for (auto wire : module->wires()) {
-				if (wire->port_input) {
-					SigSpec sig = sigmap(wire);
-					for (int i = 0; i < GetSize(sig); i++)
-						wire_drivers[sig[i]].push_back(stringf("module input %s[%d]", log_id(wire), i));
-				}
-				if (wire->port_output)
-					for (auto bit : sigmap(wire))
-						if (bit.wire) used_wires.insert(bit);
-				if (wire->port_input && !wire->port_output)
-					for (auto bit : sigmap(wire))
-						if (bit.wire) wire_drivers_count[bit]++;
-				if (wire->attributes.count(ID::init)) {
-					Const initval = wire->attributes.at(ID::init);
-					for (int i = 0; i < GetSize(initval) && i < GetSize(wire); i++)
-						if (initval[i] == State::S0 || initval[i] == State::S1)
-							init_bits.insert(sigmap(SigBit(wire, i)));
-					if (noinit) {
-						log_warning("Wire %s.%s has an unprocessed 'init' attribute.\n", log_id(module), log_id(wire));
-						counter++;
-					}
-				}
-			}
-
-			for (auto it : wire_drivers)
-				if (wire_drivers_count[it.first] > 1) {
-					string message = stringf("multiple conflicting drivers for %s.%s:\n", log_id(module), log_signal(it.first));
-					for (auto str : it.second)
-						message += stringf("    %s\n", str.c_str());
-					log_warning("%s", message.c_str());
-					counter++;
-				}
-
-			for (auto bit : used_wires)
-				if (!wire_drivers.count(bit)) {
-					log_warning("Wire %s.%s is used but has no driver.\n", log_id(module), log_signal(bit));
-					counter++;
-				}
-
-			topo.sort();
-			for (auto &loop : topo.loops) {
-				string message = stringf("found logic loop in module %s:\n", log_id(module));
-				for (auto &str : loop)
-					message += stringf("    %s\n", str.c_str());
-				log_warning("%s", message.c_str());
-				counter++;
+			std::string module_options = options + " " + instantiated_interfaces(module);
+			const std::vector<std::string> *problems = cache.lookup(module, module_options);
+			if (problems != nullptr) {
+				log("Module %s has not been changed since it was last checked.\n", log_id(module));
+				worker.problems = *problems;
+			} else {
+				worker.problems.clear();
+				worker.check(module);
+				if (module->processes.empty())
+					cache.insert(module, module_options, worker.problems);
 			}
 
-			if (initdrv)
-			{
-				for (auto cell : module->cells())
-				{
-					if (RTLIL::builtin_ff_cell_types().count(cell->type) == 0)
-						continue;
-
-					for (auto bit : sigmap(cell->getPort(ID::Q)))
-						init_bits.erase(bit);
-				}
-
-				SigSpec init_sig(init_bits);
-				init_sig.sort_and_unify();
-
-				for (auto chunk : init_sig.chunks()) {
-					log_warning("Wire %s.%s has 'init' attribute and is not driven by an FF cell.\n", log_id(module), log_signal(chunk));
-					counter++;
-				}
-			}
+			for (auto &problem : worker.problems)
+				log_warning("%s", problem.c_str());
+			counter += GetSize(worker.problems);
 		}
 
 		log("Found and reported %d problems.\n", counter);
@@ -0,0 +1,197 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/yosys.h"
+#include "kernel/passcache.h"
+#include "libs/sha1/sha1.h"
+
+USING_YOSYS_NAMESPACE
+PRIVATE_NAMESPACE_BEGIN
+
+struct CheckpointHasher
+{
+	RTLIL::Design *design;
+	dict<RTLIL::IdString, std::string> hashes;
+
+	CheckpointHasher(RTLIL::Design *design) : design(design) { }
+
+	// The hash of a module covers the modules it instantiates, so that a change in a submodule
+	// also invalidates the modules it may have been flattened into.
+	const std::string &hash(RTLIL::Module *module)
+	{
+		auto it = hashes.find(module->name);
+		if (it != hashes.end())
+			return it->second;
+
+		pool<RTLIL::IdString> submodules;
+		for (auto cell : module->cells())
+			if (design->module(cell->type) != nullptr)
+				submodules.insert(cell->type);
+		submodules.sort(RTLIL::sort_by_id_str());
+
+		std::string hash_data = stringf("%s\n", yosys_version_str);
+		for (auto type : submodules)
+			hash_data += stringf("submodule %s %s\n", log_id(type), hash(design->module(type)).c_str());
+		hash_data += PassCache::canonical_text(module);
+
+		return hashes[module->name] = sha1(hash_data);
+	}
+};
+
+struct CheckpointPass : public Pass {
+	// The checkpoint modules that are reused in the current design, and have been replaced
+	// by black box placeholders until 'checkpoint -save' is called.
+	std::unique_ptr<RTLIL::Design> reused_modules;
+
+	CheckpointPass() : Pass("checkpoint", "incremental synthesis using netlist checkpoints") { }
+	void on_shutdown() override
+	{
+		reused_modules.reset();
+	}
+	void help() override
+	{
+		//   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
+		log("\n");
+		log("    checkpoint -load <filename>\n");
+		log("\n");
+		log("Compare the modules in the current design to the modules in a checkpoint written\n");
+		log("by 'checkpoint -save' in a previous run. Each module is hashed (together with all\n");
+		log("modules it instantiates, and ignoring the numbering of auto-generated names), and\n");
+		log("modules with the same hash as the corresponding module in the checkpoint are\n");
+		log("replaced by black box placeholders, so that the following synthesis commands\n");
+		log("only process the modules that changed since the checkpoint was written. The\n");
+		log("remaining modules are tagged with their hash.\n");
+		log("\n");
+		log("This command should be run on the elaborated design, i.e. after 'hierarchy', so\n");
+		log("that parametrised variants of modules are compared individually. If the file\n");
+		log("does not exist, all modules are tagged.\n");
+		log("\n");
+		log("\n");
+		log("    checkpoint -save <filename>\n");
+		log("\n");
+		log("Replace the placeholders created by 'checkpoint -load' with the corresponding\n");
+		log("modules from the checkpoint, and write the complete design to a new checkpoint\n");
+		log("(in RTLIL format). Only tagged modules can be reused in the next run.\n");
+		log("\n");
+		log("\n");
+		log("A typical incremental flow looks like this:\n");
+		log("\n");
+		log("    read_verilog ...\n");
+		log("    hierarchy -top top\n");
+		log("    checkpoint -load top.ckpt.il\n");
+		log("    synth -top top\n");
+		log("    checkpoint -save top.ckpt.il\n");
+		log("\n");
+		log("The checkpoint must be discarded when the synthesis script is changed. As the\n");
+		log("placeholders are black boxes, this only works for flows that keep the hierarchy.\n");
+		log("\n");
+	}
+	void execute(std::vector<std::string> args, RTLIL::Design *design) override
+	{
+		std::string load_filename, save_filename;
+
+		log_header(design, "Executing CHECKPOINT pass (incremental synthesis).\n");
+
+		size_t argidx;
+		for (argidx = 1; argidx < args.size(); argidx++) {
+			if (args[argidx] == "-load" && argidx+1 < args.size()) {
+				load_filename = args[++argidx];
+				continue;
+			}
+			if (args[argidx] == "-save" && argidx+1 < args.size()) {
+				save_filename = args[++argidx];
+				continue;
+			}
+			break;
+		}
+		extra_args(args, argidx, design, false);
+
+		if (load_filename.empty() == save_filename.empty())
+			log_cmd_error("Exactly one of -load and -save must be specified.\n");
+
+		if (!save_filename.empty()) {
+			int restored = 0, tagged = 0;
+			for (auto module : design->modules().to_vector()) {
+				if (!module->get_blackbox_attribute() || !module->has_attribute(ID::checkpoint_hash))
+					continue;
+				RTLIL::Module *reused = reused_modules ? reused_modules->module(module->name) : nullptr;
+				if (reused == nullptr || reused->get_string_attribute(ID::checkpoint_hash) != module->get_string_attribute(ID::checkpoint_hash))
+					log_error("Placeholder for module %s does not match a module loaded by 'checkpoint -load'.\n", log_id(module));
+				design->remove(module);
+				design->add(reused->clone());
+				restored++;
+			}
+			for (auto module : design->modules())
+				if (module->has_attribute(ID::checkpoint_hash))
+					tagged++;
+
+			rewrite_filename(save_filename);
+			log("Restored %d modules from previous checkpoint.\n", restored);
+			log("Writing checkpoint with %d of %d modules tagged to `%s'.\n", tagged, GetSize(design->modules()), save_filename.c_str());
+			Backend::backend_call(design, nullptr, save_filename, "rtlil");
+			return;
+		}
+
+		rewrite_filename(load_filename);
+		reused_modules.reset(new RTLIL::Design);
+		if (check_file_exists(load_filename)) {
+			log_push();
+			Frontend::frontend_call(reused_modules.get(), nullptr, load_filename, "rtlil");
+			log_pop();
+		} else
+			log("Checkpoint `%s' does not exist, starting from scratch.\n", load_filename.c_str());
+
+		CheckpointHasher hasher(design);
+		std::vector<std::pair<RTLIL::Module*, std::string>> module_hashes;
+		for (auto module : design->modules())
+			if (!module->get_blackbox_attribute())
+				module_hashes.push_back(std::make_pair(module, hasher.hash(module)));
+
+		int reused = 0, changed = 0;
+		for (auto &it : module_hashes) {
+			RTLIL::Module *module = it.first;
+			RTLIL::Module *old_module = reused_modules->module(module->name);
+			if (old_module == nullptr || old_module->get_string_attribute(ID::checkpoint_hash) != it.second) {
+				log("Module %s %s.\n", log_id(module), old_module ? "has changed" : "is not in the checkpoint");
+				module->set_string_attribute(ID::checkpoint_hash, it.second);
+				changed++;
+				continue;
+			}
+
+			log_debug("Reusing module %s from checkpoint.\n", log_id(module));
+			RTLIL::Module *placeholder = new RTLIL::Module;
+			placeholder->name = module->name;
+			placeholder->attributes = old_module->attributes;
+			placeholder->set_bool_attribute(ID::blackbox);
+			for (auto port : old_module->ports) {
+				RTLIL::Wire *wire = old_module->wire(port);
+				RTLIL::Wire *new_wire = placeholder->addWire(port, wire);
+				new_wire->attributes.clear();
+			}
+			placeholder->fixup_ports();
+			design->remove(module);
+			design->add(placeholder);
+			reused++;
+		}
+
+		log("Reused %d modules from checkpoint, %d modules need to be synthesized.\n", reused, changed);
+	}
+} CheckpointPass;
+
+PRIVATE_NAMESPACE_END
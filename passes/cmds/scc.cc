@@ -24,6 +24,7 @@
 #include "kernel/register.h"
 #include "kernel/celltypes.h"
 #include "kernel/sigtools.h"
+#include "kernel/utils.h"
 #include "kernel/log.h"
 #include <stdlib.h>
 #include <stdio.h>
@@ -40,66 +41,10 @@ struct SccWorker
 	CellTypes ct, specifyCells;
 
 	std::set<RTLIL::Cell*> workQueue;
-	std::map<RTLIL::Cell*, std::set<RTLIL::Cell*>> cellToNextCell;
 	std::map<RTLIL::Cell*, RTLIL::SigSpec> cellToPrevSig, cellToNextSig;
 
-	std::map<RTLIL::Cell*, std::pair<int, int>> cellLabels;
-	std::map<RTLIL::Cell*, int> cellDepth;
-	std::set<RTLIL::Cell*> cellsOnStack;
-	std::vector<RTLIL::Cell*> cellStack;
-	int labelCounter;
-
-	std::map<RTLIL::Cell*, int> cell2scc;
 	std::vector<std::set<RTLIL::Cell*>> sccList;
 
-	void run(RTLIL::Cell *cell, int depth, int maxDepth)
-	{
-		log_assert(workQueue.count(cell) > 0);
-
-		workQueue.erase(cell);
-		cellLabels[cell] = std::pair<int, int>(labelCounter, labelCounter);
-		labelCounter++;
-
-		cellsOnStack.insert(cell);
-		cellStack.push_back(cell);
-
-		if (maxDepth >= 0)
-			cellDepth[cell] = depth;
-
-		for (auto nextCell : cellToNextCell[cell])
-			if (cellLabels.count(nextCell) == 0) {
-				run(nextCell, depth+1, maxDepth);
-				cellLabels[cell].second = min(cellLabels[cell].second, cellLabels[nextCell].second);
-			} else
-			if (cellsOnStack.count(nextCell) > 0 && (maxDepth < 0 || cellDepth[nextCell] + maxDepth > depth)) {
-					cellLabels[cell].second = min(cellLabels[cell].second, cellLabels[nextCell].second);
-			}
-
-		if (cellLabels[cell].first == cellLabels[cell].second)
-		{
-			if (cellStack.back() == cell)
-			{
-				cellStack.pop_back();
-				cellsOnStack.erase(cell);
-			}
-			else
-			{
-				log("Found an SCC:");
-				std::set<RTLIL::Cell*> scc;
-				while (cellsOnStack.count(cell) > 0) {
-					RTLIL::Cell *c = cellStack.back();
-					cellStack.pop_back();
-					cellsOnStack.erase(c);
-					log(" %s", RTLIL::id2cstr(c->name));
-					cell2scc[c] = sccList.size();
-					scc.insert(c);
-				}
-				sccList.push_back(scc);
-				log("\n");
-			}
-		}
-	}
-
 	SccWorker(RTLIL::Design *design, RTLIL::Module *module, bool nofeedbackMode, bool allCellTypes, bool specifyMode, int maxDepth) :
 			design(design), module(module), sigmap(module)
 	{
@@ -128,7 +73,6 @@ struct SccWorker
 		}
 
 		SigPool selectedSignals;
-		SigSet<RTLIL::Cell*> sigToNextCells;
 
 		for (auto &it : module->wires_)
 			if (design->selected(module, it.second))
@@ -194,34 +138,64 @@ struct SccWorker
 
 			cellToPrevSig[cell] = inputSignals;
 			cellToNextSig[cell] = outputSignals;
-			sigToNextCells.insert(inputSignals, cell);
 		}
 
-		for (auto cell : workQueue)
+		// Number the cells in the order of the work queue, so that the search
+		// visits them in the same order as before.
+		std::vector<RTLIL::Cell*> cells(workQueue.begin(), workQueue.end());
+		dict<RTLIL::SigBit, std::vector<int>> sigToNextCells;
+
+		for (int i = 0; i < GetSize(cells); i++) {
+			for (auto bit : cellToPrevSig[cells[i]])
+				sigToNextCells[bit].push_back(i);
+		}
+
+		std::vector<std::pair<int, int>> edges;
+		std::vector<int> nextCells;
+
+		for (int i = 0; i < GetSize(cells); i++)
 		{
-			cellToNextCell[cell] = sigToNextCells.find(cellToNextSig[cell]);
+			RTLIL::Cell *cell = cells[i];
+
+			nextCells.clear();
+			for (auto bit : cellToNextSig[cell]) {
+				auto it = sigToNextCells.find(bit);
+				if (it != sigToNextCells.end())
+					nextCells.insert(nextCells.end(), it->second.begin(), it->second.end());
+			}
+			std::sort(nextCells.begin(), nextCells.end());
+			nextCells.erase(std::unique(nextCells.begin(), nextCells.end()), nextCells.end());
 
-			if (!nofeedbackMode && cellToNextCell[cell].count(cell)) {
+			for (int next : nextCells)
+				edges.push_back(std::make_pair(i, next));
+
+			if (!nofeedbackMode && std::binary_search(nextCells.begin(), nextCells.end(), i)) {
 				log("Found an SCC:");
 				std::set<RTLIL::Cell*> scc;
 				log(" %s", RTLIL::id2cstr(cell->name));
-				cell2scc[cell] = sccList.size();
 				scc.insert(cell);
 				sccList.push_back(scc);
 				log("\n");
 			}
 		}
 
-		labelCounter = 0;
-		cellLabels.clear();
+		SccGraph graph(GetSize(cells), edges);
+		graph.find(maxDepth);
 
-		while (!workQueue.empty())
+		for (int i = 0; i < graph.components(); i++)
 		{
-			RTLIL::Cell *cell = *workQueue.begin();
-			log_assert(cellStack.size() == 0);
-			cellDepth.clear();
+			if (graph.component_size(i) < 2)
+				continue;
 
-			run(cell, 0, maxDepth);
+			log("Found an SCC:");
+			std::set<RTLIL::Cell*> scc;
+			for (int j = graph.component_offsets[i]; j < graph.component_offsets[i+1]; j++) {
+				RTLIL::Cell *c = cells[graph.component_nodes[j]];
+				log(" %s", RTLIL::id2cstr(c->name));
+				scc.insert(c);
+			}
+			sccList.push_back(scc);
+			log("\n");
 		}
 
 		log("Found %d SCCs in module %s.\n", int(sccList.size()), RTLIL::id2cstr(module->name));
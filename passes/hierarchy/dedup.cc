@@ -0,0 +1,318 @@
+/*
+ *  yosys -- Yosys Open SYnthesis Suite
+ *
+ *  Copyright (C) 2012  Claire Xenia Wolf <claire@yosyshq.com>
+ *
+ *  Permission to use, copy, modify, and/or distribute this software for any
+ *  purpose with or without fee is hereby granted, provided that the above
+ *  copyright notice and this permission notice appear in all copies.
+ *
+ *  THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ *
+ */
+
+#include "kernel/yosys.h"
+#include "libs/sha1/sha1.h"
+
+USING_YOSYS_NAMESPACE
+PRIVATE_NAMESPACE_BEGIN
+
+// Computes a canonical text representation of a module, in which the names of private wires and cells
+// are replaced by numbers that only depend on the structure of the module. Two modules with the same
+// canonical text are interchangeable. The numbering is derived from a few rounds of label refinement over
+// the netlist; if it can't tell two private wires apart, it falls back to their original order, which
+// may cause two isomorphic modules not to be recognized as such, but never the other way around.
+struct ModuleCanonicalizer
+{
+	RTLIL::Module *module;
+	std::vector<RTLIL::Wire*> wires;
+	dict<RTLIL::Wire*, int> wire_index;
+	std::vector<std::string> wire_names;
+
+	ModuleCanonicalizer(RTLIL::Module *module) : module(module) { }
+
+	static std::string dump_attributes(const dict<IdString, RTLIL::Const> &attributes)
+	{
+		std::vector<std::string> entries;
+		for (auto &it : attributes)
+			if (it.first != ID::src && it.first != ID::dedup_module)
+				entries.push_back(stringf(" %s=%s", it.first.c_str(), log_const(it.second)));
+		std::sort(entries.begin(), entries.end());
+		std::string text;
+		for (auto &entry : entries)
+			text += entry;
+		return text;
+	}
+
+	static std::string dump_parameters(const dict<IdString, RTLIL::Const> &parameters)
+	{
+		std::vector<std::string> entries;
+		for (auto &it : parameters)
+			entries.push_back(stringf(" %s=%s%s", it.first.c_str(), log_const(it.second),
+					it.second.flags & RTLIL::CONST_FLAG_SIGNED ? "s" : ""));
+		std::sort(entries.begin(), entries.end());
+		std::string text;
+		for (auto &entry : entries)
+			text += entry;
+		return text;
+	}
+
+	std::string dump_sig(const RTLIL::SigSpec &sig, const std::vector<std::string> &names)
+	{
+		std::string text;
+		for (auto &chunk : sig.chunks())
+			if (chunk.wire == nullptr)
+				text += " " + RTLIL::Const(chunk.data).as_string();
+			else
+				text += stringf(" %s[%d+:%d]", names.at(wire_index.at(chunk.wire)).c_str(), chunk.offset, chunk.width);
+		return text;
+	}
+
+	std::string dump_cell(RTLIL::Cell *cell, const std::vector<std::string> &names)
+	{
+		std::string text = stringf("cell %s %s", cell->name[0] == '\\' ? cell->name.c_str() : "$", cell->type.c_str());
+		text += dump_parameters(cell->parameters);
+		text += dump_attributes(cell->attributes);
+		std::vector<IdString> ports;
+		for (auto &conn : cell->connections())
+			ports.push_back(conn.first);
+		std::sort(ports.begin(), ports.end(), RTLIL::sort_by_id_str());
+		for (auto port : ports)
+			text += stringf(" %s:", port.c_str()) + dump_sig(cell->getPort(port), names);
+		return text;
+	}
+
+	// Returns the canonical text of the module, or an empty string if the module can't be deduplicated.
+	std::string canonicalize(int rounds = 3)
+	{
+		if (!module->processes.empty() || !module->memories.empty())
+			return std::string();
+
+		for (auto wire : module->wires()) {
+			wire_index[wire] = GetSize(wires);
+			wires.push_back(wire);
+		}
+
+		// Initial labels only depend on the properties of each wire itself.
+		std::vector<std::string> labels;
+		for (auto wire : wires)
+			labels.push_back(sha1(stringf("%s %d %d %d %d %d %d %d%s", wire->name[0] == '\\' ? wire->name.c_str() : "$",
+					wire->width, wire->start_offset, wire->upto, wire->is_signed, wire->port_id, wire->port_input,
+					wire->port_output, dump_attributes(wire->attributes).c_str())));
+
+		// Each round, relabel every wire by the cells and connections it is attached to.
+		for (int round = 0; round < rounds; round++) {
+			std::vector<std::vector<std::string>> neighbours(GetSize(wires));
+			for (auto cell : module->cells()) {
+				std::string cell_label = sha1(dump_cell(cell, labels));
+				for (auto &conn : cell->connections())
+					for (int i = 0; i < GetSize(conn.second); i++)
+						if (conn.second[i].wire != nullptr)
+							neighbours[wire_index.at(conn.second[i].wire)].push_back(stringf("%s %s %d %d",
+									cell_label.c_str(), conn.first.c_str(), i, conn.second[i].offset));
+			}
+			for (auto &conn : module->connections())
+				for (int i = 0; i < GetSize(conn.first); i++) {
+					SigBit lhs = conn.first[i], rhs = conn.second[i];
+					std::string lhs_label = lhs.wire ? labels[wire_index.at(lhs.wire)] + stringf(" %d", lhs.offset) : log_signal(lhs);
+					std::string rhs_label = rhs.wire ? labels[wire_index.at(rhs.wire)] + stringf(" %d", rhs.offset) : log_signal(rhs);
+					if (lhs.wire)
+						neighbours[wire_index.at(lhs.wire)].push_back(stringf("< %d %s", lhs.offset, rhs_label.c_str()));
+					if (rhs.wire)
+						neighbours[wire_index.at(rhs.wire)].push_back(stringf("> %d %s", rhs.offset, lhs_label.c_str()));
+				}
+			std::vector<std::string> new_labels;
+			for (int i = 0; i < GetSize(wires); i++) {
+				std::sort(neighbours[i].begin(), neighbours[i].end());
+				std::string text = labels[i];
+				for (auto &neighbour : neighbours[i])
+					text += "|" + neighbour;
+				new_labels.push_back(sha1(text));
+			}
+			labels.swap(new_labels);
+		}
+
+		std::vector<int> order;
+		for (int i = 0; i < GetSize(wires); i++)
+			order.push_back(i);
+		std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+			bool a_public = wires[a]->name[0] == '\\', b_public = wires[b]->name[0] == '\\';
+			if (a_public != b_public)
+				return a_public;
+			if (a_public)
+				return wires[a]->name.str() < wires[b]->name.str();
+			return labels[a] < labels[b];
+		});
+
+		wire_names.resize(GetSize(wires));
+		for (int i = 0; i < GetSize(order); i++) {
+			RTLIL::Wire *wire = wires[order[i]];
+			wire_names[order[i]] = wire->name[0] == '\\' ? wire->name.str() : stringf("$%d", i);
+		}
+
+		std::string text = stringf("module%s\n", dump_attributes(module->attributes).c_str());
+		for (auto param : module->avail_parameters)
+			text += stringf("parameter %s\n", param.c_str());
+		for (int index : order) {
+			RTLIL::Wire *wire = wires[index];
+			text += stringf("wire %s %d %d %d %d %d %d %d%s\n", wire_names[index].c_str(), wire->width, wire->start_offset,
+					wire->upto, wire->is_signed, wire->port_id, wire->port_input, wire->port_output,
+					dump_attributes(wire->attributes).c_str());
+		}
+
+		std::vector<std::string> lines;
+		for (auto cell : module->cells())
+			lines.push_back(dump_cell(cell, wire_names));
+		for (auto &conn : module->connections())
+			lines.push_back("connect" + dump_sig(conn.first, wire_names) + " =" + dump_sig(conn.second, wire_names));
+		std::sort(lines.begin(), lines.end());
+		for (auto &line : lines)
+			text += line + "\n";
+		return text;
+	}
+};
+
+struct DedupPass : public Pass {
+	DedupPass() : Pass("dedup", "merge structurally identical modules") { }
+	void help() override
+	{
+		//   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
+		log("\n");
+		log("    dedup [options] [selection]\n");
+		log("\n");
+		log("This pass finds selected modules that are structurally identical (for example\n");
+		log("copies of the same module derived with different parameters that do not change\n");
+		log("its netlist), keeps one of them, and changes all instances of the others to\n");
+		log("instantiate the kept module. This way, each unique module is only processed\n");
+		log("once by subsequent passes.\n");
+		log("\n");
+		log("Two modules are considered identical if they only differ in the names of their\n");
+		log("private ($-prefixed) wires and cells and in their 'src' attributes. Modules\n");
+		log("containing processes or memories, blackbox modules and the top module are\n");
+		log("never merged. Merging is repeated until no more modules can be merged, so that\n");
+		log("modules that only differ in the names of merged submodules are merged as well.\n");
+		log("\n");
+		log("Each instance of a removed module is marked with the 'dedup_module' attribute,\n");
+		log("which holds the name of the module it originally instantiated.\n");
+		log("\n");
+		log("    -undo\n");
+		log("        instead of merging modules, restore the original module hierarchy by\n");
+		log("        creating a copy of the current implementation for each module removed\n");
+		log("        by an earlier call to this pass.\n");
+		log("\n");
+	}
+	void execute(std::vector<std::string> args, RTLIL::Design *design) override
+	{
+		bool undo_mode = false;
+
+		size_t argidx;
+		for (argidx = 1; argidx < args.size(); argidx++) {
+			if (args[argidx] == "-undo") {
+				undo_mode = true;
+				continue;
+			}
+			break;
+		}
+		extra_args(args, argidx, design);
+
+		if (undo_mode)
+		{
+			log_header(design, "Executing DEDUP pass (restoring merged modules).\n");
+
+			int count = 0;
+			bool did_something = true;
+			while (did_something)
+			{
+				did_something = false;
+				for (auto module : design->selected_modules())
+				for (auto cell : module->selected_cells())
+				{
+					if (!cell->has_attribute(ID::dedup_module))
+						continue;
+
+					IdString orig_name = RTLIL::escape_id(cell->get_string_attribute(ID::dedup_module));
+					RTLIL::Module *impl = design->module(cell->type);
+					if (impl != nullptr && design->module(orig_name) == nullptr) {
+						log("Creating module %s from %s.\n", log_id(orig_name), log_id(impl));
+						RTLIL::Module *copy = impl->clone();
+						copy->name = orig_name;
+						design->add(copy);
+						count++;
+						did_something = true;
+					}
+					cell->type = orig_name;
+					cell->attributes.erase(ID::dedup_module);
+				}
+			}
+
+			log("Restored %d modules.\n", count);
+			return;
+		}
+
+		log_header(design, "Executing DEDUP pass (merging structurally identical modules).\n");
+
+		int count = 0;
+		bool did_something = true;
+		while (did_something)
+		{
+			did_something = false;
+
+			dict<std::string, std::vector<RTLIL::Module*>> groups;
+			for (auto module : design->selected_whole_modules_warn())
+			{
+				if (module->get_blackbox_attribute() || module->get_bool_attribute(ID::top))
+					continue;
+				std::string text = ModuleCanonicalizer(module).canonicalize();
+				if (!text.empty())
+					groups[sha1(text)].push_back(module);
+			}
+
+			dict<IdString, IdString> replaced;
+			for (auto &it : groups)
+			{
+				if (GetSize(it.second) < 2)
+					continue;
+
+				std::vector<RTLIL::Module*> &modules = it.second;
+				std::sort(modules.begin(), modules.end(), [](RTLIL::Module *a, RTLIL::Module *b) {
+					return a->name.str() < b->name.str();
+				});
+
+				RTLIL::Module *keep = modules.front();
+				for (int i = 1; i < GetSize(modules); i++) {
+					log("Merging module %s into identical module %s.\n", log_id(modules[i]), log_id(keep));
+					replaced[modules[i]->name] = keep->name;
+				}
+			}
+
+			if (replaced.empty())
+				break;
+
+			for (auto module : design->modules())
+				for (auto cell : module->cells()) {
+					auto it = replaced.find(cell->type);
+					if (it == replaced.end())
+						continue;
+					if (!cell->has_attribute(ID::dedup_module))
+						cell->set_string_attribute(ID::dedup_module, cell->type.str());
+					cell->type = it->second;
+				}
+
+			for (auto &it : replaced)
+				design->remove(design->module(it.first));
+
+			count += GetSize(replaced);
+			did_something = true;
+		}
+
+		log("Removed %d duplicate modules.\n", count);
+	}
+} DedupPass;
+
+PRIVATE_NAMESPACE_END
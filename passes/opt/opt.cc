@@ -19,12 +19,124 @@
 
 #include "kernel/register.h"
 #include "kernel/log.h"
+#include "kernel/modcache.h"
 #include <stdlib.h>
 #include <stdio.h>
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
 
+// Runs the opt_* passes only on the modules that have been changed since the
+// respective pass was last run on them. The passes are deterministic, so a pass
+// that has already been run on an unchanged module would not find anything to do.
+struct OptScheduler
+{
+	RTLIL::Design *design;
+	std::vector<RTLIL::IdString> modules;
+	dict<std::string, pool<RTLIL::IdString>> clean_modules;
+	pool<RTLIL::IdString> round_modules, round_changed_modules;
+	dict<RTLIL::IdString, int> iterations;
+
+	OptScheduler(RTLIL::Design *design) : design(design)
+	{
+		for (auto module : design->selected_modules()) {
+			modules.push_back(module->name);
+			iterations[module->name] = 0;
+		}
+	}
+
+	// Returns true if the pass has changed any module.
+	bool run(const std::string &command)
+	{
+		pool<RTLIL::IdString> &clean = clean_modules[command];
+		std::vector<RTLIL::IdString> todo;
+		for (auto name : modules)
+			if (!clean.count(name) && design->module(name) != nullptr)
+				todo.push_back(name);
+
+		if (todo.empty()) {
+			log("\nSkipping `%s', no module has changed since it was last run.\n", command.c_str());
+			return false;
+		}
+
+		// Changes are detected by comparing fingerprints, as passes also change cell types,
+		// parameters and attributes in place, which is not reported to monitors.
+		dict<RTLIL::IdString, unsigned int> fingerprints;
+		for (auto name : todo)
+			fingerprints[name] = module_fingerprint(design->module(name));
+
+		bool did_something_before = design->scratchpad_get_bool("opt.did_something");
+		design->scratchpad_unset("opt.did_something");
+
+		if (GetSize(todo) == GetSize(modules)) {
+			Pass::call(design, command);
+		} else {
+			const RTLIL::Selection &current = design->selection();
+			RTLIL::Selection selection(false);
+			for (auto name : todo) {
+				if (current.selected_whole_module(name))
+					selection.selected_modules.insert(name);
+				else
+					selection.selected_members[name] = current.selected_members.at(name);
+			}
+			Pass::call_on_selection(design, selection, command);
+		}
+
+		bool pass_did_something = design->scratchpad_get_bool("opt.did_something");
+		if (did_something_before)
+			design->scratchpad_set_bool("opt.did_something", true);
+
+		std::vector<RTLIL::IdString> changed;
+		for (auto name : todo) {
+			RTLIL::Module *module = design->module(name);
+			if (module == nullptr)
+				continue;
+			if (module_fingerprint(module) != fingerprints.at(name))
+				changed.push_back(name);
+		}
+
+		for (auto name : todo)
+			clean.insert(name);
+		for (auto name : changed)
+			for (auto &it : clean_modules)
+				it.second.erase(name);
+
+		// Some passes rewrite connections with equivalent signals without reporting a
+		// change. This makes the other passes look at the module again, but does not
+		// make the opt loop run for another iteration.
+		for (auto name : todo)
+			round_modules.insert(name);
+		if (!pass_did_something)
+			return false;
+		for (auto name : changed)
+			round_changed_modules.insert(name);
+		return true;
+	}
+
+	// Ends an iteration of the opt loop. Returns the number of modules that
+	// have been changed in it.
+	int next_iteration()
+	{
+		for (auto name : round_modules)
+			iterations[name]++;
+		round_modules.clear();
+
+		int changed = GetSize(round_changed_modules);
+		round_changed_modules.clear();
+		return changed;
+	}
+
+	void log_iterations()
+	{
+		if (GetSize(modules) < 2)
+			return;
+		log("\nNumber of iterations per module:\n");
+		for (auto name : modules)
+			if (design->module(name) != nullptr)
+				log("  %5d %s\n", iterations.at(name), log_id(name));
+	}
+};
+
 struct OptPass : public Pass {
 	OptPass() : Pass("opt", "perform simple optimizations") { }
 	void help() override
@@ -59,6 +171,11 @@ struct OptPass : public Pass {
 		log("        opt_clean [-purge]\n");
 		log("    while <changed design in opt_dff>\n");
 		log("\n");
+		log("The passes are only re-run on the modules that have been changed since the\n");
+		log("respective pass was last run on them. Passes that would not see any changed\n");
+		log("module are skipped. If more than one module is selected, the number of loop\n");
+		log("iterations for each module is reported at the end.\n");
+		log("\n");
 		log("Note: Options in square brackets (such as [-keepdc]) are passed through to\n");
 		log("the opt_* commands when given to 'opt'.\n");
 		log("\n");
@@ -144,42 +261,47 @@ struct OptPass : public Pass {
 		}
 		extra_args(args, argidx, design);
 
+		OptScheduler scheduler(design);
+
 		if (fast_mode)
 		{
 			while (1) {
-				Pass::call(design, "opt_expr" + opt_expr_args);
-				Pass::call(design, "opt_merge" + opt_merge_args);
-				design->scratchpad_unset("opt.did_something");
-				if (!noff_mode)
-					Pass::call(design, "opt_dff" + opt_dff_args);
-				if (design->scratchpad_get_bool("opt.did_something") == false)
+				scheduler.run("opt_expr" + opt_expr_args);
+				scheduler.run("opt_merge" + opt_merge_args);
+				if (noff_mode || !scheduler.run("opt_dff" + opt_dff_args)) {
+					scheduler.next_iteration();
 					break;
-				Pass::call(design, "opt_clean" + opt_clean_args);
+				}
+				scheduler.run("opt_clean" + opt_clean_args);
+				scheduler.next_iteration();
 				log_header(design, "Rerunning OPT passes. (Removed registers in this run.)\n");
 			}
-			Pass::call(design, "opt_clean" + opt_clean_args);
+			scheduler.run("opt_clean" + opt_clean_args);
 		}
 		else
 		{
-			Pass::call(design, "opt_expr" + opt_expr_args);
-			Pass::call(design, "opt_merge -nomux" + opt_merge_args);
+			scheduler.run("opt_expr" + opt_expr_args);
+			scheduler.run("opt_merge -nomux" + opt_merge_args);
 			while (1) {
-				design->scratchpad_unset("opt.did_something");
-				Pass::call(design, "opt_muxtree");
-				Pass::call(design, "opt_reduce" + opt_reduce_args);
-				Pass::call(design, "opt_merge" + opt_merge_args);
+				scheduler.run("opt_muxtree");
+				scheduler.run("opt_reduce" + opt_reduce_args);
+				scheduler.run("opt_merge" + opt_merge_args);
 				if (opt_share)
-					Pass::call(design, "opt_share");
+					scheduler.run("opt_share");
 				if (!noff_mode)
-					Pass::call(design, "opt_dff" + opt_dff_args);
-				Pass::call(design, "opt_clean" + opt_clean_args);
-				Pass::call(design, "opt_expr" + opt_expr_args);
-				if (design->scratchpad_get_bool("opt.did_something") == false)
+					scheduler.run("opt_dff" + opt_dff_args);
+				scheduler.run("opt_clean" + opt_clean_args);
+				scheduler.run("opt_expr" + opt_expr_args);
+				int changed = scheduler.next_iteration();
+				if (changed == 0)
 					break;
 				log_header(design, "Rerunning OPT passes. (Maybe there is more to do..)\n");
+				log("Modules changed in the last iteration: %d of %d\n", changed, GetSize(scheduler.modules));
 			}
 		}
 
+		scheduler.log_iterations();
+
 		design->optimize();
 		design->sort();
 		design->check();
@@ -570,6 +570,239 @@ void rmunused_module(RTLIL::Module *module, bool purge_mode, bool verbose, bool
 		while (rmunused_module_signals(module, purge_mode, verbose)) { }
 }
 
+// Removes module ports that are not needed, together with the logic that becomes unused, for
+// 'opt_clean -hier'. Ports are only removed from modules of which all instances are known, i.e.
+// modules that are only instantiated (without parameters, and using named port connections) in
+// the cleaned modules. Dead outputs are found top-down, as they depend on all instances, and
+// ports that are not connected inside the module are found bottom-up, so that each module is
+// only cleaned again after one of its own ports or the ports of its submodules were removed.
+struct HierCleanWorker
+{
+	Design *design;
+	pool<Module*> modules, candidates, dirty;
+	dict<Module*, pool<Module*>> parents;
+	std::vector<Module*> topdown;
+	int count_rm_ports = 0;
+
+	// what is known about a module as an instantiating module, until it is cleaned again
+	struct parent_info_t {
+		dict<IdString, std::vector<Cell*>> instances;
+		bool has_read_bits = false;
+		SigMap sigmap;
+		pool<SigBit> read_bits;
+	};
+	dict<Module*, parent_info_t> parent_info_cache;
+
+	HierCleanWorker(Design *design, const std::vector<Module*> &selected) : design(design)
+	{
+		for (auto module : selected)
+			modules.insert(module);
+
+		pool<Module*> not_candidates;
+		for (auto module : design->modules())
+		for (auto cell : module->cells()) {
+			Module *submodule = design->module(cell->type);
+			if (submodule == nullptr || !modules.count(submodule))
+				continue;
+			parents[submodule].insert(module);
+			bool known_ports = true;
+			for (auto &conn : cell->connections()) {
+				Wire *wire = submodule->wire(conn.first);
+				if (wire == nullptr || wire->port_id == 0)
+					known_ports = false;
+			}
+			if (!modules.count(module) || !cell->parameters.empty() || cell->has_keep_attr() || !known_ports)
+				not_candidates.insert(submodule);
+		}
+
+		for (auto &it : parents)
+			if (!not_candidates.count(it.first) && !it.first->get_bool_attribute(ID::top) && !it.first->get_bool_attribute(ID::keep))
+				candidates.insert(it.first);
+
+		pool<Module*> visited;
+		for (auto module : modules)
+			add_bottom_up(module, visited);
+		std::reverse(topdown.begin(), topdown.end());
+	}
+
+	// Appends the module after all of its submodules.
+	void add_bottom_up(Module *module, pool<Module*> &visited)
+	{
+		if (!visited.insert(module).second)
+			return;
+		for (auto cell : module->cells()) {
+			Module *submodule = design->module(cell->type);
+			if (submodule != nullptr && modules.count(submodule))
+				add_bottom_up(submodule, visited);
+		}
+		topdown.push_back(module);
+	}
+
+	void clean(Module *module, bool purge_mode, bool verbose)
+	{
+		if (!dirty.count(module))
+			return;
+		dirty.erase(module);
+		parent_info_cache.erase(module);
+		rmunused_module(module, purge_mode, verbose, true);
+	}
+
+	parent_info_t &parent_info(Module *module, bool need_read_bits = false)
+	{
+		auto it = parent_info_cache.find(module);
+		if (it == parent_info_cache.end()) {
+			it = parent_info_cache.insert(std::make_pair(module, parent_info_t())).first;
+			for (auto cell : module->cells())
+				if (candidates.count(design->module(cell->type)))
+					it->second.instances[cell->type].push_back(cell);
+		}
+
+		parent_info_t &info = it->second;
+		if (need_read_bits && !info.has_read_bits) {
+			info.has_read_bits = true;
+			info.sigmap.set(module);
+			for (auto cell : module->cells())
+			for (auto &conn : cell->connections())
+				if (!ct_all.cell_known(cell->type) || ct_all.cell_input(cell->type, conn.first))
+					for (auto bit : info.sigmap(conn.second))
+						info.read_bits.insert(bit);
+			for (auto wire : module->wires())
+				if (wire->port_output || wire->get_bool_attribute(ID::keep))
+					for (auto bit : info.sigmap(wire))
+						info.read_bits.insert(bit);
+		}
+		return info;
+	}
+
+	std::vector<Cell*> instances(Module *module)
+	{
+		std::vector<Cell*> result;
+		for (auto parent : parents.at(module)) {
+			auto &parent_instances = parent_info(parent).instances;
+			auto it = parent_instances.find(module->name);
+			if (it != parent_instances.end())
+				result.insert(result.end(), it->second.begin(), it->second.end());
+		}
+		return result;
+	}
+
+	// Output ports that are not read by any instance of the module.
+	pool<IdString> unread_outputs(Module *module)
+	{
+		pool<IdString> result;
+		std::vector<Cell*> cells = instances(module);
+		if (cells.empty())
+			return result;
+
+		for (auto port : module->ports) {
+			Wire *wire = module->wire(port);
+			if (wire->port_input || wire->get_bool_attribute(ID::keep))
+				continue;
+			bool unread = true;
+			for (auto cell : cells) {
+				auto it = cell->connections().find(port);
+				if (it == cell->connections().end())
+					continue;
+				auto &info = parent_info(cell->module, true);
+				for (auto bit : info.sigmap(it->second))
+					if (bit.wire != nullptr && info.read_bits.count(bit))
+						unread = false;
+				if (!unread)
+					break;
+			}
+			if (unread)
+				result.insert(port);
+		}
+		return result;
+	}
+
+	// Ports that are not connected to anything inside the module.
+	pool<IdString> unconnected_ports(Module *module)
+	{
+		pool<Wire*> connected;
+		for (auto &conn : module->connections()) {
+			for (auto bit : conn.first)
+				if (bit.wire != nullptr && bit.wire->port_id > 0)
+					connected.insert(bit.wire);
+			for (auto bit : conn.second)
+				if (bit.wire != nullptr && bit.wire->port_id > 0)
+					connected.insert(bit.wire);
+		}
+		for (auto cell : module->cells())
+		for (auto &conn : cell->connections())
+			for (auto bit : conn.second)
+				if (bit.wire != nullptr && bit.wire->port_id > 0)
+					connected.insert(bit.wire);
+
+		pool<IdString> result;
+		if (instances(module).empty())
+			return result;
+		for (auto port : module->ports) {
+			Wire *wire = module->wire(port);
+			if (!connected.count(wire) && !wire->get_bool_attribute(ID::keep))
+				result.insert(port);
+		}
+		return result;
+	}
+
+	void remove_ports(Module *module, const pool<IdString> &ports)
+	{
+		for (auto port : ports) {
+			log_debug("  removing unused port `%s' of module `%s'.\n", port.c_str(), module->name.c_str());
+			Wire *wire = module->wire(port);
+			wire->port_input = false;
+			wire->port_output = false;
+		}
+		module->fixup_ports();
+
+		for (auto cell : instances(module)) {
+			for (auto port : ports)
+				cell->unsetPort(port);
+			dirty.insert(cell->module);
+		}
+
+		dirty.insert(module);
+		count_rm_ports += GetSize(ports);
+		design->scratchpad_set_bool("opt.did_something", true);
+	}
+
+	void run(bool purge_mode, bool verbose)
+	{
+		dirty = modules;
+		while (1)
+		{
+			int count_before = count_rm_ports;
+
+			for (auto module : topdown) {
+				clean(module, purge_mode, verbose);
+				if (!candidates.count(module))
+					continue;
+				pool<IdString> ports = unread_outputs(module);
+				if (ports.empty())
+					continue;
+				remove_ports(module, ports);
+				clean(module, purge_mode, verbose);
+			}
+
+			for (auto it = topdown.rbegin(); it != topdown.rend(); ++it) {
+				Module *module = *it;
+				clean(module, purge_mode, verbose);
+				if (!candidates.count(module))
+					continue;
+				pool<IdString> ports = unconnected_ports(module);
+				if (!ports.empty())
+					remove_ports(module, ports);
+			}
+
+			if (count_rm_ports == count_before)
+				break;
+		}
+
+		for (auto module : topdown)
+			clean(module, purge_mode, verbose);
+	}
+};
+
 struct OptCleanPass : public Pass {
 	OptCleanPass() : Pass("opt_clean", "remove unused cells and wires") { }
 	void help() override
@@ -588,10 +821,19 @@ struct OptCleanPass : public Pass {
 		log("    -purge\n");
 		log("        also remove internal nets if they have a public name\n");
 		log("\n");
+		log("    -hier\n");
+		log("        also remove module ports that are not connected inside the module, and\n");
+		log("        output ports that are not used by any instance of the module, together\n");
+		log("        with the logic that becomes unused in the module and its instantiating\n");
+		log("        modules. this is repeated until no more ports can be removed. ports are\n");
+		log("        only removed from modules that are instantiated, and only instantiated\n");
+		log("        in the selected modules, and not from the top module.\n");
+		log("\n");
 	}
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
 	{
 		bool purge_mode = false;
+		bool hier_mode = false;
 
 		log_header(design, "Executing OPT_CLEAN pass (remove unused cells and wires).\n");
 		log_push();
@@ -602,6 +844,10 @@ struct OptCleanPass : public Pass {
 				purge_mode = true;
 				continue;
 			}
+			if (args[argidx] == "-hier") {
+				hier_mode = true;
+				continue;
+			}
 			break;
 		}
 		extra_args(args, argidx, design);
@@ -616,10 +862,21 @@ struct OptCleanPass : public Pass {
 		count_rm_cells = 0;
 		count_rm_wires = 0;
 
+		std::vector<RTLIL::Module*> modules;
 		for (auto module : design->selected_whole_modules_warn()) {
 			if (module->has_processes_warn())
 				continue;
-			rmunused_module(module, purge_mode, true, true);
+			modules.push_back(module);
+		}
+
+		if (hier_mode) {
+			HierCleanWorker worker(design, modules);
+			worker.run(purge_mode, true);
+			if (worker.count_rm_ports > 0)
+				log("Removed %d unused ports.\n", worker.count_rm_ports);
+		} else {
+			for (auto module : modules)
+				rmunused_module(module, purge_mode, true, true);
 		}
 
 		if (count_rm_cells > 0 || count_rm_wires > 0)
@@ -22,6 +22,7 @@
 #include "kernel/register.h"
 #include "kernel/rtlil.h"
 #include "kernel/satgen.h"
+#include "kernel/consteval.h"
 #include "kernel/sigtools.h"
 #include "kernel/ffinit.h"
 #include "kernel/ff.h"
@@ -62,6 +63,10 @@ struct OptDffWorker
 	SatGen satgen;
 	pool<Cell*> sat_cells;
 
+	// FF bits (sigmapped Q and D) that can not be replaced by the given constant, because
+	// a counter example has been found by simulate_sat_candidates().
+	dict<std::pair<SigBit, SigBit>, State> sim_counter_examples;
+
 	// Used as a queue.
 	std::vector<Cell *> dff_cells;
 
@@ -104,19 +109,24 @@ struct OptDffWorker
 
 	}
 
-	std::function<void(Cell*)> sat_import_cell = [&](Cell *c) {
-		if (!sat_cells.insert(c).second)
-			return;
-		if (!satgen.importCell(c))
-			return;
-		for (auto &conn : c->connections()) {
-			if (!c->input(conn.first))
+	void sat_import_cell(Cell *cell) {
+		std::vector<Cell*> queue = {cell};
+		while (!queue.empty()) {
+			Cell *c = queue.back();
+			queue.pop_back();
+			if (!sat_cells.insert(c).second)
 				continue;
-			for (auto bit : sigmap(conn.second))
-				if (bit2driver.count(bit))
-					sat_import_cell(bit2driver.at(bit));
+			if (!satgen.importCell(c))
+				continue;
+			for (auto &conn : c->connections()) {
+				if (!c->input(conn.first))
+					continue;
+				for (auto bit : sigmap(conn.second))
+					if (bit2driver.count(bit))
+						queue.push_back(bit2driver.at(bit));
+			}
 		}
-	};
+	}
 
 	State combine_const(State a, State b) {
 		if (a == State::Sx && !opt.keepdc)
@@ -128,6 +138,97 @@ struct OptDffWorker
 		return State::Sm;
 	}
 
+	// The constant a FF bit could be replaced with, not considering the D input (or State::Sm if there is none).
+	State const_value(const FfData &ff, int i) {
+		State val = ff.val_init[i];
+		if (ff.has_arst)
+			val = combine_const(val, ff.val_arst[i]);
+		if (ff.has_srst)
+			val = combine_const(val, ff.val_srst[i]);
+		if (ff.has_sr) {
+			if (ff.sig_clr[i] != (ff.pol_clr ? State::S0 : State::S1))
+				val = combine_const(val, State::S0);
+			if (ff.sig_set[i] != (ff.pol_set ? State::S0 : State::S1))
+				val = combine_const(val, State::S1);
+		}
+		return val;
+	}
+
+	// Before running one SAT query per FF bit, simulate the module with a few random input patterns.
+	// In each round the Q outputs of a random subset of the candidate bits (all of them in the first
+	// round) are set to their constant value. A candidate in that subset whose D input then has a
+	// different value can change, and does not need to be checked with the SAT solver. The cones of
+	// the remaining candidates are imported into the SAT solver in one go.
+	void simulate_sat_candidates() {
+		std::vector<std::tuple<SigBit, SigBit, State>> candidates;
+		pool<SigBit> candidate_q;
+
+		for (auto cell : dff_cells) {
+			FfData ff(&initvals, cell);
+			if (!ff.has_d)
+				continue;
+			for (int i = 0; i < ff.width; i++) {
+				SigBit q = sigmap(ff.sig_q[i]);
+				SigBit d = sigmap(ff.sig_d[i]);
+				State val = const_value(ff, i);
+				if (!q.wire || !d.wire || !bit2driver.count(d))
+					continue;
+				if (val != State::S0 && val != State::S1)
+					continue;
+				if (candidate_q.insert(q).second)
+					candidates.emplace_back(q, d, val);
+			}
+		}
+
+		if (candidates.empty())
+			return;
+
+		ConstEval ce(module);
+		unsigned int rng = 123456789;
+		int num_candidates = GetSize(candidates);
+
+		for (int round = 0; round < 16 && !candidates.empty(); round++) {
+			ce.clear();
+			std::vector<std::tuple<SigBit, SigBit, State>> remaining, checked;
+			for (auto &it : candidates) {
+				rng = mkhash_xorshift(rng);
+				if (round == 0 || (rng & 1)) {
+					ce.set(std::get<0>(it), std::get<2>(it));
+					checked.push_back(it);
+				} else
+					remaining.push_back(it);
+			}
+
+			for (auto &it : checked) {
+				SigSpec sig = std::get<1>(it), undef;
+				while (!ce.eval(sig, undef)) {
+					pool<SigBit> undef_bits;
+					for (auto bit : undef)
+						if (bit.wire && undef_bits.insert(bit).second) {
+							rng = mkhash_xorshift(rng);
+							ce.set(bit, rng & 1 ? State::S1 : State::S0);
+						}
+					if (undef_bits.empty())
+						break;
+					sig = std::get<1>(it);
+					undef = SigSpec();
+				}
+				State val = std::get<2>(it);
+				if (sig[0] == (val == State::S0 ? State::S1 : State::S0))
+					sim_counter_examples[std::make_pair(std::get<0>(it), std::get<1>(it))] = val;
+				else
+					remaining.push_back(it);
+			}
+			candidates.swap(remaining);
+		}
+
+		log("Simulation ruled out %d of %d FF bits in module %s, checking %d bits with SAT.\n",
+				num_candidates - GetSize(candidates), num_candidates, log_id(module), GetSize(candidates));
+
+		for (auto &it : candidates)
+			sat_import_cell(bit2driver.at(std::get<1>(it)));
+	}
+
 	patterns_t find_muxtree_feedback_patterns(RTLIL::SigBit d, RTLIL::SigBit q, pattern_t path)
 	{
 		patterns_t ret;
@@ -287,6 +388,8 @@ struct OptDffWorker
 	bool run() {
 		// We have all the information we need, and the list of FFs to process as well.  Do it.
 		bool did_something = false;
+		if (opt.sat)
+			simulate_sat_candidates();
 		while (!dff_cells.empty()) {
 			Cell *cell = dff_cells.back();
 			dff_cells.pop_back();
@@ -572,17 +675,7 @@ struct OptDffWorker
 			// Now check if any bit can be replaced by a constant.
 			pool<int> removed_sigbits;
 			for (int i = 0; i < ff.width; i++) {
-				State val = ff.val_init[i];
-				if (ff.has_arst)
-					val = combine_const(val, ff.val_arst[i]);
-				if (ff.has_srst)
-					val = combine_const(val, ff.val_srst[i]);
-				if (ff.has_sr) {
-					if (ff.sig_clr[i] != (ff.pol_clr ? State::S0 : State::S1))
-						val = combine_const(val, State::S0);
-					if (ff.sig_set[i] != (ff.pol_set ? State::S0 : State::S1))
-						val = combine_const(val, State::S1);
-				}
+				State val = const_value(ff, i);
 				if (val == State::Sm)
 					continue;
 				if (ff.has_d) {
@@ -599,6 +692,10 @@ struct OptDffWorker
 						if (val != State::S0 && val != State::S1)
 							continue;
 
+						auto it = sim_counter_examples.find(std::make_pair(sigmap(ff.sig_q[i]), sigmap(ff.sig_d[i])));
+						if (it != sim_counter_examples.end() && it->second == val)
+							continue;
+
 						sat_import_cell(bit2driver.at(ff.sig_d[i]));
 
 						int init_sat_pi = satgen.importSigSpec(val).front();
@@ -814,7 +911,9 @@ struct OptDffPass : public Pass {
 		log("\n");
 		log("    -sat\n");
 		log("        additionally invoke SAT solver to detect and remove flip-flops (with\n");
-		log("        non-constant inputs) that can also be replaced with a constant driver\n");
+		log("        non-constant inputs) that can also be replaced with a constant driver.\n");
+		log("        a quick random simulation is used to avoid SAT queries for bits that\n");
+		log("        obviously can change.\n");
 		log("\n");
 		log("    -keepdc\n");
 		log("        some optimizations change the behavior of the circuit with respect to\n");
@@ -20,6 +20,7 @@
 #include "kernel/register.h"
 #include "kernel/sigtools.h"
 #include "kernel/celltypes.h"
+#include "kernel/modtools.h"
 #include "kernel/utils.h"
 #include "kernel/log.h"
 #include <stdlib.h>
@@ -31,6 +32,149 @@ PRIVATE_NAMESPACE_BEGIN
 
 bool did_something;
 
+// Keeps track of the cells that replace_const_cells() needs to visit again: cells that have been
+// added or changed, and all cells connected to nets whose drivers or connections have changed since
+// the last call. There are separate worklists for the calls with and without consume_x.
+//
+// The cells connected to a changed net are looked up when the change is notified, and only then is the
+// change passed on to the index. Once a net has been connected to a constant, the index no longer knows
+// the cells connected to it.
+struct OptExprWorklist : public RTLIL::Monitor
+{
+	RTLIL::Module *module;
+	ModIndex index;
+
+	bool full_scan[2];
+	pool<RTLIL::IdString> dirty_cells[2];
+
+	// The single-bit inverters, i.e. the cells that are used to build the invert_map
+	bool full_inverter_scan;
+	pool<RTLIL::IdString> dirty_inverters;
+	dict<RTLIL::IdString, RTLIL::SigSig> inverters;
+
+	std::vector<int> visit_counts;
+
+	OptExprWorklist(RTLIL::Module *module) : module(module), index(module)
+	{
+		full_scan[0] = full_scan[1] = true;
+		full_inverter_scan = true;
+		module->monitors.erase(&index);
+		module->monitors.insert(this);
+	}
+
+	~OptExprWorklist()
+	{
+		module->monitors.erase(this);
+	}
+
+	void mark_cell(RTLIL::Cell *cell)
+	{
+		dirty_cells[0].insert(cell->name);
+		dirty_cells[1].insert(cell->name);
+		dirty_inverters.insert(cell->name);
+	}
+
+	void mark_sig(const RTLIL::SigSpec &sig)
+	{
+		for (auto bit : sig)
+			if (bit.wire)
+				for (auto &port : index.query_ports(bit)) {
+					dirty_cells[0].insert(port.cell->name);
+					dirty_cells[1].insert(port.cell->name);
+				}
+	}
+
+	// Called for a cell that has been changed in place (e.g. its type), without a notification.
+	void mark_cell_and_fanout(RTLIL::Cell *cell)
+	{
+		mark_cell(cell);
+		for (auto &conn : cell->connections())
+			if (cell->output(conn.first))
+				mark_sig(conn.second);
+	}
+
+	void notify_connect(RTLIL::Cell *cell, const RTLIL::IdString &port, const RTLIL::SigSpec &old_sig, const RTLIL::SigSpec &sig) override
+	{
+		mark_cell(cell);
+		if (cell->output(port)) {
+			mark_sig(old_sig);
+			mark_sig(sig);
+		}
+		index.notify_connect(cell, port, old_sig, sig);
+	}
+
+	void notify_connect(RTLIL::Module *mod, const RTLIL::SigSig &sigsig) override
+	{
+		mark_sig(sigsig.first);
+		mark_sig(sigsig.second);
+		index.notify_connect(mod, sigsig);
+	}
+
+	void notify_connect(RTLIL::Module *mod, const std::vector<RTLIL::SigSig> &sigsig_vec) override
+	{
+		full_scan[0] = full_scan[1] = true;
+		full_inverter_scan = true;
+		index.notify_connect(mod, sigsig_vec);
+	}
+
+	void notify_blackout(RTLIL::Module *mod) override
+	{
+		full_scan[0] = full_scan[1] = true;
+		full_inverter_scan = true;
+		index.notify_blackout(mod);
+	}
+
+	// Returns the cells to visit in the call with (or without) consume_x, and empties that worklist.
+	std::vector<RTLIL::Cell*> fetch(bool consume_x)
+	{
+		std::vector<RTLIL::Cell*> cells;
+		if (full_scan[consume_x]) {
+			cells = module->cells();
+		} else {
+			pool<RTLIL::Cell*> cell_set;
+			for (auto name : dirty_cells[consume_x]) {
+				RTLIL::Cell *cell = module->cell(name);
+				if (cell != nullptr)
+					cell_set.insert(cell);
+			}
+			cells.insert(cells.end(), cell_set.begin(), cell_set.end());
+		}
+		full_scan[consume_x] = false;
+		dirty_cells[consume_x].clear();
+		return cells;
+	}
+
+	void check_inverter(RTLIL::Design *design, RTLIL::Cell *cell)
+	{
+		if (!design->selected(module, cell) || cell->type[0] != '$')
+			return;
+		if (cell->type.in(ID($_NOT_), ID($not), ID($logic_not)) &&
+				GetSize(cell->getPort(ID::A)) == 1 && GetSize(cell->getPort(ID::Y)) == 1)
+			inverters[cell->name] = RTLIL::SigSig(cell->getPort(ID::Y), cell->getPort(ID::A));
+		if (cell->type.in(ID($mux), ID($_MUX_)) &&
+				cell->getPort(ID::A) == SigSpec(State::S1) && cell->getPort(ID::B) == SigSpec(State::S0))
+			inverters[cell->name] = RTLIL::SigSig(cell->getPort(ID::Y), cell->getPort(ID::S));
+	}
+
+	void update_inverters(RTLIL::Design *design)
+	{
+		if (full_inverter_scan) {
+			inverters.clear();
+			for (auto cell : module->cells())
+				check_inverter(design, cell);
+		} else {
+			for (auto name : dirty_inverters) {
+				inverters.erase(name);
+				RTLIL::Cell *cell = module->cell(name);
+				if (cell != nullptr)
+					check_inverter(design, cell);
+			}
+		}
+		full_inverter_scan = false;
+		dirty_inverters.clear();
+	}
+};
+
 void replace_undriven(RTLIL::Module *module, const CellTypes &ct)
 {
 	SigMap sigmap(module);
@@ -393,7 +537,8 @@ int get_highest_hot_index(RTLIL::SigSpec signal)
 	return -1;
 }
 
-void replace_const_cells(RTLIL::Design *design, RTLIL::Module *module, bool consume_x, bool mux_undef, bool mux_bool, bool do_fine, bool keepdc, bool noclkinv)
+void replace_const_cells(RTLIL::Design *design, RTLIL::Module *module, bool consume_x, bool mux_undef, bool mux_bool, bool do_fine, bool keepdc, bool noclkinv,
+		OptExprWorklist *worklist = nullptr)
 {
 	if (!design->selected(module))
 		return;
@@ -409,12 +554,18 @@ void replace_const_cells(RTLIL::Design *design, RTLIL::Module *module, bool cons
 	dict<RTLIL::Cell*, std::set<RTLIL::SigBit>> cell_to_inbit;
 	dict<RTLIL::SigBit, std::set<RTLIL::Cell*>> outbit_to_cell;
 
-	for (auto cell : module->cells())
+	if (worklist) {
+		worklist->update_inverters(design);
+		for (auto &it : worklist->inverters)
+			invert_map[assign_map(it.second.first)] = assign_map(it.second.second);
+	}
+
+	for (auto cell : worklist ? worklist->fetch(consume_x) : module->cells().to_vector())
 		if (design->selected(module, cell) && cell->type[0] == '$') {
-			if (cell->type.in(ID($_NOT_), ID($not), ID($logic_not)) &&
+			if (!worklist && cell->type.in(ID($_NOT_), ID($not), ID($logic_not)) &&
 					GetSize(cell->getPort(ID::A)) == 1 && GetSize(cell->getPort(ID::Y)) == 1)
 				invert_map[assign_map(cell->getPort(ID::Y))] = assign_map(cell->getPort(ID::A));
-			if (cell->type.in(ID($mux), ID($_MUX_)) &&
+			if (!worklist && cell->type.in(ID($mux), ID($_MUX_)) &&
 					cell->getPort(ID::A) == SigSpec(State::S1) && cell->getPort(ID::B) == SigSpec(State::S0))
 				invert_map[assign_map(cell->getPort(ID::Y))] = assign_map(cell->getPort(ID::S));
 			if (ct_combinational.cell_known(cell->type))
@@ -437,8 +588,16 @@ void replace_const_cells(RTLIL::Design *design, RTLIL::Module *module, bool cons
 
 	cells.sort();
 
+	if (worklist)
+		worklist->visit_counts.push_back(GetSize(cells.sorted));
+
 	for (auto cell : cells.sorted)
 	{
+		// Cells that are changed in place need to be visited again in the next call.
+		bool did_something_before = did_something;
+		RTLIL::IdString cell_name = cell->name;
+		did_something = false;
+
 #define ACTION_DO(_p_, _s_) do { cover("opt.opt_expr.action_" S__LINE__); replace_cell(assign_map, module, cell, input.as_string(), _p_, _s_); goto next_cell; } while (0)
 #define ACTION_DO_Y(_v_) ACTION_DO(ID::Y, RTLIL::SigSpec(RTLIL::State::S ## _v_))
 
@@ -1999,7 +2158,10 @@ skip_alu_split:
 			}
 		}
 
-	next_cell:;
+	next_cell:
+		if (did_something && worklist && module->cell(cell_name) != nullptr)
+			worklist->mark_cell_and_fanout(module->cell(cell_name));
+		did_something = did_something || did_something_before;
 #undef ACTION_DO
 #undef ACTION_DO_Y
 #undef FOLD_1ARG_CELL
@@ -2096,6 +2258,7 @@ struct OptExprPass : public Pass {
 		for (auto module : design->selected_modules())
 		{
 			log("Optimizing module %s.\n", log_id(module));
+			OptExprWorklist worklist(module);
 
 			if (undriven) {
 				did_something = false;
@@ -2107,16 +2270,23 @@ struct OptExprPass : public Pass {
 			do {
 				do {
 					did_something = false;
-					replace_const_cells(design, module, false /* consume_x */, mux_undef, mux_bool, do_fine, keepdc, noclkinv);
+					replace_const_cells(design, module, false /* consume_x */, mux_undef, mux_bool, do_fine, keepdc, noclkinv, &worklist);
 					if (did_something)
 						design->scratchpad_set_bool("opt.did_something", true);
 				} while (did_something);
 				if (!keepdc)
-					replace_const_cells(design, module, true /* consume_x */, mux_undef, mux_bool, do_fine, keepdc, noclkinv);
+					replace_const_cells(design, module, true /* consume_x */, mux_undef, mux_bool, do_fine, keepdc, noclkinv, &worklist);
 				if (did_something)
 					design->scratchpad_set_bool("opt.did_something", true);
 			} while (did_something);
 
+			if (GetSize(worklist.visit_counts) > 1) {
+				std::string counts;
+				for (int count : worklist.visit_counts)
+					counts += stringf(" %d", count);
+				log("Cells visited per iteration:%s.\n", counts.c_str());
+			}
+
 			log_suppressed();
 		}
 
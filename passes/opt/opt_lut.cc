@@ -38,27 +38,57 @@ struct OptLutWorker
 
 	int eliminated_count = 0, combined_count = 0;
 
-	bool evaluate_lut(RTLIL::Cell *lut, dict<SigBit, bool> inputs)
+	// Truth tables are evaluated for all assignments of the LUT inputs at once, using one bit
+	// per assignment. Tables of functions of less than 6 inputs are repeated to fill a 64-bit
+	// word, so that they can be compared word by word.
+	static int truth_table_words(int vars)
+	{
+		return vars <= 6 ? 1 : 1 << (vars - 6);
+	}
+
+	static std::vector<uint64_t> truth_table_var(int vars, int var)
+	{
+		static const uint64_t patterns[6] = {
+			0xaaaaaaaaaaaaaaaaULL, 0xccccccccccccccccULL, 0xf0f0f0f0f0f0f0f0ULL,
+			0xff00ff00ff00ff00ULL, 0xffff0000ffff0000ULL, 0xffffffff00000000ULL,
+		};
+		std::vector<uint64_t> table(truth_table_words(vars));
+		for (int i = 0; i < GetSize(table); i++)
+			table[i] = var < 6 ? patterns[var] : ((i >> (var - 6)) & 1) ? ~0ULL : 0ULL;
+		return table;
+	}
+
+	std::vector<uint64_t> evaluate_lut(RTLIL::Cell *lut, const dict<SigBit, std::vector<uint64_t>> &inputs, int words)
 	{
 		SigSpec lut_input = sigmap(lut->getPort(ID::A));
 		int lut_width = lut->getParam(ID::WIDTH).as_int();
-		Const lut_table = lut->getParam(ID::LUT);
-		int lut_index = 0;
+		const Const &lut_table = lut->getParam(ID::LUT);
+
+		// Start with a constant table for each entry of the LUT, then select between pairs of
+		// tables using the LUT inputs, starting with the least significant one.
+		std::vector<uint64_t> tables(words << lut_width);
+		for (int index = 0; index < 1 << lut_width; index++)
+			if (index < GetSize(lut_table) && lut_table[index] == State::S1)
+				for (int k = 0; k < words; k++)
+					tables[index*words + k] = ~0ULL;
 
 		for (int i = 0; i < lut_width; i++)
 		{
 			SigBit input = sigmap(lut_input[i]);
-			if (inputs.count(input))
-			{
-				lut_index |= inputs[input] << i;
-			}
-			else
-			{
-				lut_index |= SigSpec(lut_input[i]).as_bool() << i;
-			}
+			auto it = inputs.find(input);
+			std::vector<uint64_t> const_table;
+			if (it == inputs.end())
+				const_table.resize(words, SigSpec(lut_input[i]).as_bool() ? ~0ULL : 0ULL);
+			const std::vector<uint64_t> &input_table = it != inputs.end() ? it->second : const_table;
+
+			for (int index = 0; index < 1 << (lut_width - i - 1); index++)
+				for (int k = 0; k < words; k++)
+					tables[index*words + k] = (input_table[k] & tables[(2*index+1)*words + k]) |
+							(~input_table[k] & tables[2*index*words + k]);
 		}
 
-		return lut_table.extract(lut_index).as_bool();
+		tables.resize(words);
+		return tables;
 	}
 
 	void show_stats_by_arity()
@@ -215,28 +245,17 @@ struct OptLutWorker
 					lut_inputs.push_back(sigmap(bit));
 			}
 
-			bool const0_match = true;
-			bool const1_match = true;
-			vector<bool> input_matches;
+			int words = truth_table_words(GetSize(lut_inputs));
+			dict<SigBit, std::vector<uint64_t>> eval_inputs;
 			for (size_t i = 0; i < lut_inputs.size(); i++)
-				input_matches.push_back(true);
+				eval_inputs[lut_inputs[i]] = truth_table_var(GetSize(lut_inputs), i);
+			std::vector<uint64_t> value = evaluate_lut(lut, eval_inputs, words);
 
-			for (int eval = 0; eval < 1 << lut_inputs.size(); eval++)
-			{
-				dict<SigBit, bool> eval_inputs;
-				for (size_t i = 0; i < lut_inputs.size(); i++)
-					eval_inputs[lut_inputs[i]] = (eval >> i) & 1;
-				bool value = evaluate_lut(lut, eval_inputs);
-				if (value != 0)
-					const0_match = false;
-				if (value != 1)
-					const1_match = false;
-				for (size_t i = 0; i < lut_inputs.size(); i++)
-				{
-					if (value != eval_inputs[lut_inputs[i]])
-						input_matches[i] = false;
-				}
-			}
+			bool const0_match = value == std::vector<uint64_t>(words, 0ULL);
+			bool const1_match = value == std::vector<uint64_t>(words, ~0ULL);
+			vector<bool> input_matches;
+			for (size_t i = 0; i < lut_inputs.size(); i++)
+				input_matches.push_back(value == eval_inputs.at(lut_inputs[i]));
 
 			int input_match = -1;
 			for (size_t i = 0; i < lut_inputs.size(); i++)
@@ -471,17 +490,16 @@ struct OptLutWorker
 					}
 					log_assert(lutR_unique.size() == 0);
 
+					int words = truth_table_words(lutM_width);
+					dict<SigBit, std::vector<uint64_t>> eval_inputs;
+					for (size_t i = 0; i < lutM_new_inputs.size(); i++)
+						eval_inputs[lutM_new_inputs[i]] = truth_table_var(lutM_width, i);
+					eval_inputs[lutA_output] = evaluate_lut(lutA, eval_inputs, words);
+					std::vector<uint64_t> lutM_value = evaluate_lut(lutB, eval_inputs, words);
+
 					RTLIL::Const lutM_new_table(State::Sx, 1 << lutM_width);
 					for (int eval = 0; eval < 1 << lutM_width; eval++)
-					{
-						dict<SigBit, bool> eval_inputs;
-						for (size_t i = 0; i < lutM_new_inputs.size(); i++)
-						{
-							eval_inputs[lutM_new_inputs[i]] = (eval >> i) & 1;
-						}
-						eval_inputs[lutA_output] = evaluate_lut(lutA, eval_inputs);
-						lutM_new_table[eval] = (RTLIL::State) evaluate_lut(lutB, eval_inputs);
-					}
+						lutM_new_table[eval] = (RTLIL::State) ((lutM_value[eval >> 6] >> (eval & 63)) & 1);
 
 					log_debug("  Cell A truth table: %s.\n", lutA->getParam(ID::LUT).as_string().c_str());
 					log_debug("  Cell B truth table: %s.\n", lutB->getParam(ID::LUT).as_string().c_str());
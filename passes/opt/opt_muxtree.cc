@@ -289,18 +289,95 @@ struct OptMuxtreeWorker
 	struct knowledge_t
 	{
 		// database of known inactive signals
-		// the payload is a reference counter used to manage the
-		// list. when it is non-zero the signal in known to be inactive
-		vector<int> known_inactive;
+		vector<bool> known_inactive;
 
 		// database of known active signals
-		vector<int> known_active;
+		vector<bool> known_active;
 
 		// this is just used to keep track of visited muxes in order to prohibit
 		// endless recursion in mux loops
 		vector<bool> visited_muxes;
 	};
 
+	// The evaluation of a root mux from within another mux tree (with do_replace_known
+	// unset) only depends on the knowledge about the control signals in its input cone,
+	// and on which muxes in the cone have been visited. The cones are computed on demand
+	// for each root mux and abort count, and the evaluations are memoized on the part of
+	// the knowledge that falls into the cone.
+	struct coneinfo_t {
+		vector<int> ctrl_sigs;
+		vector<int> muxes;
+	};
+
+	dict<pair<int, int>, coneinfo_t> root_cones;
+	pool<vector<int>> evaluated_roots;
+
+	const coneinfo_t &root_cone(int mux_idx, int abort_count)
+	{
+		auto key = make_pair(mux_idx, abort_count);
+		auto it = root_cones.find(key);
+		if (it != root_cones.end())
+			return it->second;
+
+		pool<int> ctrl_sigs, muxes;
+		pool<pair<int, int>> seen;
+		vector<pair<int, int>> queue;
+		seen.insert(key);
+		queue.push_back(key);
+
+		while (!queue.empty())
+		{
+			int m = queue.back().first;
+			int count = queue.back().second;
+			queue.pop_back();
+
+			for (auto &portinfo : mux2info[m].ports) {
+				if (portinfo.ctrl_sig >= 0)
+					ctrl_sigs.insert(portinfo.ctrl_sig);
+				for (int n : portinfo.input_muxes) {
+					muxes.insert(n);
+					// roots that are not pure anymore are never evaluated again
+					if (root_enable_muxes.at(n))
+						continue;
+					int n_count = count;
+					if (root_muxes.at(n)) {
+						if (count == 0)
+							continue;
+						n_count--;
+					}
+					if (seen.insert(make_pair(n, n_count)).second)
+						queue.push_back(make_pair(n, n_count));
+				}
+			}
+		}
+
+		coneinfo_t &cone = root_cones[key];
+		cone.ctrl_sigs.insert(cone.ctrl_sigs.end(), ctrl_sigs.begin(), ctrl_sigs.end());
+		cone.muxes.insert(cone.muxes.end(), muxes.begin(), muxes.end());
+		std::sort(cone.ctrl_sigs.begin(), cone.ctrl_sigs.end());
+		std::sort(cone.muxes.begin(), cone.muxes.end());
+		return cone;
+	}
+
+	void eval_root_mux_in_tree(knowledge_t &knowledge, int mux_idx, bool do_enable_ports, int abort_count)
+	{
+		const coneinfo_t &cone = root_cone(mux_idx, abort_count);
+
+		vector<int> signature = {mux_idx, do_enable_ports, abort_count};
+		for (int bit : cone.ctrl_sigs)
+			if (knowledge.known_inactive[bit] || knowledge.known_active[bit])
+				signature.push_back(2*bit + knowledge.known_active[bit]);
+		signature.push_back(-1);
+		for (int m : cone.muxes)
+			if (knowledge.visited_muxes[m])
+				signature.push_back(m);
+
+		if (!evaluated_roots.insert(signature).second)
+			return;
+
+		eval_mux(knowledge, mux_idx, false, do_enable_ports, abort_count);
+	}
+
 	void eval_mux_port(knowledge_t &knowledge, int mux_idx, int port_idx, bool do_replace_known, bool do_enable_ports, int abort_count)
 	{
 		if (glob_abort_cnt == 0)
@@ -311,15 +388,26 @@ struct OptMuxtreeWorker
 		if (do_enable_ports)
 			muxinfo.ports[port_idx].enabled = true;
 
+		// remember the signals that were not known before, so that we can undo the changes
+		vector<int> new_inactive;
 		for (int i = 0; i < GetSize(muxinfo.ports); i++) {
 			if (i == port_idx)
 				continue;
-			if (muxinfo.ports[i].ctrl_sig >= 0)
-				knowledge.known_inactive.at(muxinfo.ports[i].ctrl_sig)++;
+			int ctrl_sig = muxinfo.ports[i].ctrl_sig;
+			if (ctrl_sig >= 0 && !knowledge.known_inactive[ctrl_sig]) {
+				knowledge.known_inactive[ctrl_sig] = true;
+				new_inactive.push_back(ctrl_sig);
+			}
 		}
 
-		if (port_idx < GetSize(muxinfo.ports)-1 && !muxinfo.ports[port_idx].const_activated)
-			knowledge.known_active.at(muxinfo.ports[port_idx].ctrl_sig)++;
+		int new_active = -1;
+		if (port_idx < GetSize(muxinfo.ports)-1 && !muxinfo.ports[port_idx].const_activated) {
+			int ctrl_sig = muxinfo.ports[port_idx].ctrl_sig;
+			if (!knowledge.known_active[ctrl_sig]) {
+				knowledge.known_active[ctrl_sig] = true;
+				new_active = ctrl_sig;
+			}
+		}
 
 		vector<int> parent_muxes;
 		for (int m : muxinfo.ports[port_idx].input_muxes) {
@@ -337,7 +425,7 @@ struct OptMuxtreeWorker
 					root_enable_muxes.at(m) = true;
 					log_debug("      Removing pure flag from root mux %s.\n", log_id(mux2info[m].cell));
 				} else
-					eval_mux(knowledge, m, false, do_enable_ports, abort_count - 1);
+					eval_root_mux_in_tree(knowledge, m, do_enable_ports, abort_count - 1);
 			} else
 				eval_mux(knowledge, m, do_replace_known, do_enable_ports, abort_count);
 			if (glob_abort_cnt == 0)
@@ -346,15 +434,10 @@ struct OptMuxtreeWorker
 		for (int m : parent_muxes)
 			knowledge.visited_muxes[m] = false;
 
-		if (port_idx < GetSize(muxinfo.ports)-1 && !muxinfo.ports[port_idx].const_activated)
-			knowledge.known_active.at(muxinfo.ports[port_idx].ctrl_sig)--;
-
-		for (int i = 0; i < GetSize(muxinfo.ports); i++) {
-			if (i == port_idx)
-				continue;
-			if (muxinfo.ports[i].ctrl_sig >= 0)
-				knowledge.known_inactive.at(muxinfo.ports[i].ctrl_sig)--;
-		}
+		if (new_active >= 0)
+			knowledge.known_active[new_active] = false;
+		for (int ctrl_sig : new_inactive)
+			knowledge.known_inactive[ctrl_sig] = false;
 	}
 
 	void replace_known(knowledge_t &knowledge, muxinfo_t &muxinfo, IdString portname)
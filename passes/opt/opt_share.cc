@@ -22,6 +22,7 @@
 #include "kernel/register.h"
 #include "kernel/rtlil.h"
 #include "kernel/sigtools.h"
+#include "kernel/cost.h"
 #include <algorithm>
 
 #include <stdio.h>
@@ -79,6 +80,8 @@ struct ExtSigSpec {
 
 	bool operator==(const RTLIL::SigSpec &other) const { return (sign != RTLIL::Const(0, 1)) ? false : sig == other; }
 	bool operator==(const ExtSigSpec &other) const { return is_signed == other.is_signed && sign == other.sign && sig == other.sig && semantics == other.semantics; }
+
+	unsigned int hash() const { return mkhash(mkhash(sig.hash(), sign.hash()), mkhash(is_signed, semantics.hash())); }
 };
 
 #define FINE_BITWISE_OPS ID($_AND_), ID($_NAND_), ID($_OR_), ID($_NOR_), ID($_XOR_), ID($_XNOR_), ID($_ANDNOT_), ID($_ORNOT_)
@@ -110,20 +113,51 @@ bool cell_supported(RTLIL::Cell *cell)
 
 std::map<IdString, IdString> mergeable_type_map;
 
-bool mergeable(RTLIL::Cell *a, RTLIL::Cell *b)
+RTLIL::IdString mergeable_type(RTLIL::Cell *cell)
 {
 	if (mergeable_type_map.empty()) {
 		mergeable_type_map.insert({ID($sub), ID($add)});
 	}
-	auto a_type = a->type;
-	if (mergeable_type_map.count(a_type))
-		a_type = mergeable_type_map.at(a_type);
-
-	auto b_type = b->type;
-	if (mergeable_type_map.count(b_type))
-		b_type = mergeable_type_map.at(b_type);
+	auto type = cell->type;
+	if (mergeable_type_map.count(type))
+		type = mergeable_type_map.at(type);
+	return type;
+}
 
-	return a_type == b_type;
+// Estimates the size of a supported cell in terms of the gate costs from kernel/cost.h
+int estimate_cost(RTLIL::Cell *cell)
+{
+	const dict<RTLIL::IdString, int> &gate_cost = CellCosts::default_gate_cost();
+
+	if (cell->type.in(FINE_BITWISE_OPS))
+		return gate_cost.at(cell->type);
+
+	int a_width = GetSize(cell->getPort(ID::A));
+	int b_width = GetSize(cell->getPort(ID::B));
+	int y_width = GetSize(cell->getPort(ID::Y));
+	int full_adder = 2 * gate_cost.at(ID($_XOR_)) + 2 * gate_cost.at(ID($_AND_)) + gate_cost.at(ID($_OR_));
+
+	if (cell->type == ID($and))
+		return y_width * gate_cost.at(ID($_AND_));
+	if (cell->type == ID($or))
+		return y_width * gate_cost.at(ID($_OR_));
+	if (cell->type == ID($xor))
+		return y_width * gate_cost.at(ID($_XOR_));
+	if (cell->type == ID($xnor))
+		return y_width * gate_cost.at(ID($_XNOR_));
+	if (cell->type.in(ID($add), ID($sub), ID($alu)))
+		return y_width * full_adder;
+	if (cell->type.in(ID($mul), ID($div), ID($mod), ID($divfloor), ID($modfloor)))
+		return a_width * b_width * (gate_cost.at(ID($_AND_)) + full_adder);
+	if (cell->type.in(SHIFT_OPS))
+		return y_width * std::min(b_width, 32) * gate_cost.at(ID($_MUX_));
+	if (cell->type.in(RELATIONAL_OPS))
+		return std::max(a_width, b_width) * full_adder;
+	if (cell->type.in(LOGICAL_OPS))
+		return (a_width + b_width) * gate_cost.at(ID($_OR_));
+
+	// $concat
+	return 0;
 }
 
 RTLIL::IdString decode_port_semantics(RTLIL::Cell *cell, RTLIL::IdString port_name)
@@ -215,8 +249,13 @@ void merge_operators(RTLIL::Module *module, RTLIL::Cell *mux, const std::vector<
 	RTLIL::SigSpec shared_pmux_b;
 	RTLIL::SigSpec shared_pmux_s;
 
+	// The output of a $concat cell is as wide as both of its inputs.
+	int new_out_width = conn_op_offset + conn_width;
+	if (shared_op->type == ID($concat))
+		new_out_width = std::max(new_out_width, GetSize(operand.sig) + max_width);
+
 	// Make a new wire to avoid false equivalence with whatever the former shared output was connected to.
-	Wire *new_out = module->addWire(NEW_ID, conn_op_offset + conn_width);
+	Wire *new_out = module->addWire(NEW_ID, new_out_width);
 	SigSpec new_sig_out = SigSpec(new_out, conn_op_offset, conn_width);
 
 	for (int i = 0; i < GetSize(ports); i++) {
@@ -251,7 +290,7 @@ void merge_operators(RTLIL::Module *module, RTLIL::Cell *mux, const std::vector<
 	bool is_fine = shared_op->type.in(FINE_BITWISE_OPS);
 
 	shared_op->setPort(ID::Y, new_out);
-	if (!is_fine)
+	if (!is_fine && shared_op->type != ID($concat))
 		shared_op->setParam(ID::Y_WIDTH, GetSize(new_out));
 
 	if (decode_port(shared_op, ID::A, sigmap) == operand) {
@@ -269,16 +308,36 @@ typedef struct {
 	RTLIL::Cell *mux;
 	std::vector<OpMuxConn> ports;
 	ExtSigSpec shared_operand;
+	int benefit;
 } merged_op_t;
 
 
+// Estimates the gates saved by a merger: the merged cells and the multiplexing of their outputs, less the
+// multiplexing of the non-shared operands.
+int estimate_benefit(const merged_op_t &merged, const SigMap &sigmap)
+{
+	int mux_cost = CellCosts::default_gate_cost().at(ID($_MUX_));
+	int operand_width = 0;
+	int benefit = 0;
+
+	for (const auto &p : merged.ports) {
+		RTLIL::IdString muxed_port_name = ID::A;
+		if (decode_port(p.op, ID::A, sigmap) == merged.shared_operand)
+			muxed_port_name = ID::B;
+		operand_width = std::max(operand_width, GetSize(p.op->getPort(muxed_port_name)));
+		if (p.op != merged.ports[0].op)
+			benefit += estimate_cost(p.op);
+	}
+
+	benefit += (GetSize(merged.ports) - 1) * (GetSize(merged.ports[0].sig) - operand_width) * mux_cost;
+	return benefit;
+}
+
 void check_muxed_operands(std::vector<const OpMuxConn *> &ports, const ExtSigSpec &shared_operand, const SigMap &sigmap)
 {
-	auto it = ports.begin();
 	ExtSigSpec seed;
 
-	while (it != ports.end()) {
-		auto p = *it;
+	ports.erase(std::remove_if(ports.begin(), ports.end(), [&](const OpMuxConn *p) {
 		auto op = p->op;
 
 		RTLIL::IdString muxed_port_name = ID::A;
@@ -291,20 +350,13 @@ void check_muxed_operands(std::vector<const OpMuxConn *> &ports, const ExtSigSpe
 		if (seed.empty())
 			seed = operand;
 
-		if (operand.is_signed != seed.is_signed) {
-			ports.erase(it);
-		} else {
-			++it;
-		}
-	}
+		return operand.is_signed != seed.is_signed;
+	}), ports.end());
 }
 
-ExtSigSpec find_shared_operand(const OpMuxConn* seed, std::vector<const OpMuxConn *> &ports, const std::map<ExtSigSpec, std::set<RTLIL::Cell *>> &operand_to_users, const SigMap &sigmap)
+ExtSigSpec find_shared_operand(const OpMuxConn* seed, std::vector<const OpMuxConn *> &ports, const dict<ExtSigSpec, pool<RTLIL::Cell *>> &operand_to_users, const SigMap &sigmap)
 {
-	std::set<RTLIL::Cell *> ops_using_operand;
-	std::set<RTLIL::Cell *> ops_set;
-	for(const auto& p: ports)
-		ops_set.insert(p->op);
+	pool<RTLIL::Cell *> ops_using_operand;
 
 	ExtSigSpec oper;
 
@@ -312,15 +364,15 @@ ExtSigSpec find_shared_operand(const OpMuxConn* seed, std::vector<const OpMuxCon
 
 	for (RTLIL::IdString port_name : {ID::A, ID::B}) {
 		oper = decode_port(op_a, port_name, sigmap);
-		auto operand_users = operand_to_users.at(oper);
+		auto &operand_users = operand_to_users.at(oper);
 
 		if (operand_users.size() == 1)
 			continue;
 
 		ops_using_operand.clear();
-		for (auto mux_ops: ops_set)
-			if (operand_users.count(mux_ops))
-				ops_using_operand.insert(mux_ops);
+		for (const auto& p : ports)
+			if (operand_users.count(p->op))
+				ops_using_operand.insert(p->op);
 
 		if (ops_using_operand.size() > 1) {
 			ports.erase(std::remove_if(ports.begin(), ports.end(), [&](const OpMuxConn *p) { return !ops_using_operand.count(p->op); }),
@@ -348,6 +400,10 @@ struct OptSharePass : public Pass {
 		log("allowing the cell to be merged and the multiplexer to be moved from\n");
 		log("multiplexing its output to multiplexing the non-shared input signals.\n");
 		log("\n");
+		log("The size of the cells and multiplexers is estimated in terms of simple gates.\n");
+		log("Cells are not merged if the estimate suggests that the new multiplexer would\n");
+		log("be larger than the cells and multiplexer inputs it saves.\n");
+		log("\n");
 	}
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
 	{
@@ -370,7 +426,7 @@ struct OptSharePass : public Pass {
 					for (auto bit : SigSpec(wire))
 						bit_users[sigmap(bit)]++;
 
-			std::map<ExtSigSpec, std::set<RTLIL::Cell *>> operand_to_users;
+			dict<ExtSigSpec, pool<RTLIL::Cell *>> operand_to_users;
 			dict<RTLIL::SigBit, std::pair<RTLIL::Cell *, int>> op_outbit_to_outsig;
 			bool any_shared_operands = false;
 
@@ -416,7 +472,6 @@ struct OptSharePass : public Pass {
 				int mux_port_size = GetSize(mux->getPort(ID::A));
 				int mux_port_num = GetSize(mux->getPort(ID::S)) + 1;
 
-				RTLIL::SigSpec mux_insig = sigmap(RTLIL::SigSpec{mux->getPort(ID::B), mux->getPort(ID::A)});
 				std::vector<std::set<OpMuxConn>> mux_port_conns(mux_port_num);
 				int found = 0;
 
@@ -481,88 +536,93 @@ struct OptSharePass : public Pass {
 				if (found < 2)
 					continue;
 
-				const OpMuxConn *seed = NULL;
+				// The first remaining connection of each port is a candidate for a merger. The candidates are indexed by
+				// their port offset, for finding the next seed, and by everything that the connections of a merger need
+				// to have in common, so that pmuxes with many cases are not scanned over and over.
+				typedef std::tuple<int, int, int, RTLIL::IdString> candidate_key_t;
+				std::set<std::pair<int, int>> candidates;
+				dict<candidate_key_t, std::set<int>> candidate_groups;
+
+				auto candidate_key = [&](const OpMuxConn &p) {
+					return candidate_key_t(p.mux_port_offset, p.op_outsig_offset, GetSize(p.sig), mergeable_type(p.op));
+				};
+
+				auto add_candidate = [&](int port_id) {
+					if (mux_port_conns[port_id].empty())
+						return;
+					const OpMuxConn &p = *mux_port_conns[port_id].begin();
+					candidates.insert(std::make_pair(p.mux_port_offset, port_id));
+					candidate_groups[candidate_key(p)].insert(port_id);
+				};
+
+				auto remove_candidate = [&](int port_id) {
+					const OpMuxConn &p = *mux_port_conns[port_id].begin();
+					candidates.erase(std::make_pair(p.mux_port_offset, port_id));
+					candidate_groups.at(candidate_key(p)).erase(port_id);
+					mux_port_conns[port_id].erase(mux_port_conns[port_id].begin());
+					add_candidate(port_id);
+				};
+
+				for (int mux_port_id = 0; mux_port_id < mux_port_num; mux_port_id++)
+					add_candidate(mux_port_id);
 
 				// Look through the bits of the $mux inputs and see which of them are connected to the operator
 				// results. Operator results can be concatenated with other signals before led to the $mux.
-				while (true) {
-
-					// Remove either the merged ports from the last iteration or the seed that failed to yield a merger
-					if (seed != NULL) {
-						mux_port_conns[seed->mux_port_id].erase(*seed);
-						seed = NULL;
-					}
+				while (!candidates.empty()) {
 
 					// For a new merger, find the seed op connection that starts at lowest port offset among port connections
-					for (auto &port_conns : mux_port_conns) {
-						if (!port_conns.size())
-							continue;
-
-						const OpMuxConn *next_p = &(*port_conns.begin());
-
-						if ((seed == NULL) || (seed->mux_port_offset > next_p->mux_port_offset))
-							seed = next_p;
-					}
-
-					// Cannot find the seed -> nothing to do for this $mux anymore
-					if (seed == NULL)
-						break;
+					const OpMuxConn *seed = &(*mux_port_conns[candidates.begin()->second].begin());
 
 					// Find all other op connections that start from the same port offset, and whose ops can be merged with the seed op
 					std::vector<const OpMuxConn *> mergeable_conns;
-					for (auto &port_conns : mux_port_conns) {
-						if (!port_conns.size())
-							continue;
+					for (int port_id : candidate_groups.at(candidate_key(*seed)))
+						mergeable_conns.push_back(&(*mux_port_conns[port_id].begin()));
 
-						const OpMuxConn *next_p = &(*port_conns.begin());
+					// We need at least two mergeable connections for the merger. Filter mergeable connections whose
+					// ops share an operand with seed connection's op
+					ExtSigSpec shared_operand;
+					if (mergeable_conns.size() >= 2)
+						shared_operand = find_shared_operand(seed, mergeable_conns, operand_to_users, sigmap);
 
-						if ((next_p->op_outsig_offset == seed->op_outsig_offset) &&
-						    (next_p->mux_port_offset == seed->mux_port_offset) && mergeable(next_p->op, seed->op) &&
-						    next_p->sig.size() == seed->sig.size())
-							mergeable_conns.push_back(next_p);
-					}
+					if (!shared_operand.empty())
+						check_muxed_operands(mergeable_conns, shared_operand, sigmap);
 
-					// We need at least two mergeable connections for the merger
-					if (mergeable_conns.size() < 2)
-						continue;
-
-					// Filter mergeable connections whose ops share an operand with seed connection's op
-					auto shared_operand = find_shared_operand(seed, mergeable_conns, operand_to_users, sigmap);
-
-					if (shared_operand.empty())
-						continue;
-
-					check_muxed_operands(mergeable_conns, shared_operand, sigmap);
-
-					if (mergeable_conns.size() < 2)
+					// Remove the seed that failed to yield a merger
+					if (shared_operand.empty() || mergeable_conns.size() < 2) {
+						remove_candidate(seed->mux_port_id);
 						continue;
+					}
 
 					// Remember the combination for the merger
 					std::vector<OpMuxConn> merged_ports;
-					for (auto p : mergeable_conns) {
+					for (auto p : mergeable_conns)
 						merged_ports.push_back(*p);
-						mux_port_conns[p->mux_port_id].erase(*p);
-					}
-
-					seed = NULL;
+					for (auto &p : merged_ports)
+						remove_candidate(p.mux_port_id);
 
-					merged_ops.push_back(merged_op_t{mux, merged_ports, shared_operand});
-
-					design->scratchpad_set_bool("opt.did_something", true);
+					merged_ops.push_back(merged_op_t{mux, merged_ports, shared_operand, 0});
+					merged_ops.back().benefit = estimate_benefit(merged_ops.back(), sigmap);
 				}
 
 			}
 
 			for (auto &shared : merged_ops) {
+				if (shared.benefit < 0) {
+					log("    Not merging the cells in front of %s %s, the multiplexer would be larger than the saved cells "
+					    "(estimated benefit %d).\n\n", log_id(shared.mux->type), log_id(shared.mux), shared.benefit);
+					continue;
+				}
+
 				log("    Found cells that share an operand and can be merged by moving the %s %s in front "
 				    "of "
-				    "them:\n",
-				    log_id(shared.mux->type), log_id(shared.mux));
+				    "them (estimated benefit %d):\n",
+				    log_id(shared.mux->type), log_id(shared.mux), shared.benefit);
 				for (const auto& op : shared.ports)
 					log("        %s\n", log_id(op.op));
 				log("\n");
 
 				merge_operators(module, shared.mux, shared.ports, shared.shared_operand, sigmap);
+				design->scratchpad_set_bool("opt.did_something", true);
 			}
 		}
 	}
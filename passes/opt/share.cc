@@ -36,6 +36,7 @@ struct ShareWorkerConfig
 	bool opt_force;
 	bool opt_aggressive;
 	bool opt_fast;
+	int sat_timeout;
 	pool<RTLIL::IdString> generic_uni_ops, generic_bin_ops, generic_cbin_ops, generic_other_ops;
 };
 
@@ -54,9 +55,13 @@ struct ShareWorker
 	pool<RTLIL::Cell*> cells_to_remove;
 	pool<RTLIL::Cell*> recursion_state;
 
-	SigMap topo_sigmap;
-	std::map<RTLIL::Cell*, std::set<RTLIL::Cell*, cell_ptr_cmp>, cell_ptr_cmp> topo_cell_drivers;
-	std::map<RTLIL::SigBit, std::set<RTLIL::Cell*, cell_ptr_cmp>> topo_bit_drivers;
+	CellTypes topo_ct;
+	std::unique_ptr<ModIndex> topo_index;
+	dict<RTLIL::Cell*, int> topo_level;
+	bool topo_has_scc;
+
+	int64_t sat_time_ns = 0;
+	bool sat_budget_exhausted = false;
 
 	std::vector<std::pair<RTLIL::SigBit, RTLIL::SigBit>> exclusive_ctrls;
 
@@ -348,6 +353,60 @@ struct ShareWorker
 
 	pool<RTLIL::Cell*> shareable_cells;
 
+	// The shareable cells grouped by signature, so that find_shareable_partners() only needs to
+	// look at cells that is_shareable_pair() would not reject based on the cell type and parameters.
+	dict<std::string, pool<RTLIL::Cell*>> shareable_buckets;
+	dict<RTLIL::Cell*, std::string> shareable_signatures;
+
+	bool has_width_classes(RTLIL::Cell *cell)
+	{
+		return !config.opt_aggressive && generic_ops.count(cell->type) && cell->type != ID($macc);
+	}
+
+	std::string shareable_signature(RTLIL::Cell *cell, int width_class_offset = 0)
+	{
+		if (cell->type == ID($memrd))
+			return cell->type.str() + " " + cell->parameters.at(ID::MEMID).decode_string();
+
+		// Without -aggressive the output widths of two shareable cells differ by at most a factor of two,
+		// i.e. the ceil_log2() of the widths differ by at most one.
+		if (has_width_classes(cell))
+			return stringf("%s %d", cell->type.c_str(), ceil_log2(cell->parameters.at(ID::Y_WIDTH).as_int()) + width_class_offset);
+
+		if (generic_ops.count(cell->type))
+			return cell->type.str();
+
+		std::vector<std::string> params;
+		for (auto &it : cell->parameters)
+			params.push_back(stringf(" %s=%s", log_id(it.first), it.second.as_string().c_str()));
+		std::sort(params.begin(), params.end());
+
+		std::string signature = cell->type.str();
+		for (auto &param : params)
+			signature += param;
+		return signature;
+	}
+
+	void add_shareable_cell(RTLIL::Cell *cell)
+	{
+		if (shareable_cells.count(cell))
+			return;
+		std::string signature = shareable_signature(cell);
+		shareable_cells.insert(cell);
+		shareable_buckets[signature].insert(cell);
+		shareable_signatures[cell] = signature;
+	}
+
+	void remove_shareable_cell(RTLIL::Cell *cell)
+	{
+		if (!shareable_cells.count(cell))
+			return;
+		std::string signature = shareable_signatures.at(cell);
+		shareable_cells.erase(cell);
+		shareable_buckets[signature].erase(cell);
+		shareable_signatures.erase(cell);
+	}
+
 	void find_shareable_cells()
 	{
 		for (auto cell : module->cells())
@@ -364,7 +423,7 @@ struct ShareWorker
 				continue;
 
 			if (config.opt_force) {
-				shareable_cells.insert(cell);
+				add_shareable_cell(cell);
 				continue;
 			}
 
@@ -372,25 +431,25 @@ struct ShareWorker
 				if (cell->parameters.at(ID::CLK_ENABLE).as_bool())
 					continue;
 				if (config.opt_aggressive || !modwalker.sigmap(cell->getPort(ID::ADDR)).is_fully_const())
-					shareable_cells.insert(cell);
+					add_shareable_cell(cell);
 				continue;
 			}
 
 			if (cell->type.in(ID($mul), ID($div), ID($mod), ID($divfloor), ID($modfloor))) {
 				if (config.opt_aggressive || cell->parameters.at(ID::Y_WIDTH).as_int() >= 4)
-					shareable_cells.insert(cell);
+					add_shareable_cell(cell);
 				continue;
 			}
 
 			if (cell->type.in(ID($shl), ID($shr), ID($sshl), ID($sshr))) {
 				if (config.opt_aggressive || cell->parameters.at(ID::Y_WIDTH).as_int() >= 8)
-					shareable_cells.insert(cell);
+					add_shareable_cell(cell);
 				continue;
 			}
 
 			if (generic_ops.count(cell->type)) {
 				if (config.opt_aggressive)
-					shareable_cells.insert(cell);
+					add_shareable_cell(cell);
 				continue;
 			}
 		}
@@ -494,9 +553,16 @@ struct ShareWorker
 	void find_shareable_partners(std::vector<RTLIL::Cell*> &results, RTLIL::Cell *cell)
 	{
 		results.clear();
-		for (auto c : shareable_cells)
-			if (c != cell && is_shareable_pair(c, cell))
-				results.push_back(c);
+		for (int offset = -1; offset <= 1; offset++) {
+			if (offset != 0 && !has_width_classes(cell))
+				continue;
+			auto it = shareable_buckets.find(shareable_signature(cell, offset));
+			if (it == shareable_buckets.end())
+				continue;
+			for (auto c : it->second)
+				if (c != cell && is_shareable_pair(c, cell))
+					results.push_back(c);
+		}
 	}
 
 
@@ -1002,8 +1068,7 @@ struct ShareWorker
 		TopoSort<RTLIL::Cell*, cell_ptr_cmp> toposort;
 		toposort.analyze_loops = false;
 
-		topo_sigmap.set(module);
-		topo_bit_drivers.clear();
+		SigMap sigmap(module);
 
 		dict<RTLIL::Cell*, pool<RTLIL::SigBit>> cell_to_bits;
 		dict<RTLIL::SigBit, pool<RTLIL::Cell*>> bit_to_cells;
@@ -1012,12 +1077,10 @@ struct ShareWorker
 			if (ct.cell_known(cell->type))
 				for (auto &conn : cell->connections()) {
 					if (ct.cell_output(cell->type, conn.first))
-						for (auto bit : topo_sigmap(conn.second)) {
+						for (auto bit : sigmap(conn.second))
 							cell_to_bits[cell].insert(bit);
-							topo_bit_drivers[bit].insert(cell);
-						}
 					else
-						for (auto bit : topo_sigmap(conn.second))
+						for (auto bit : sigmap(conn.second))
 							bit_to_cells[bit].insert(cell);
 				}
 
@@ -1031,7 +1094,6 @@ struct ShareWorker
 		}
 
 		bool found_scc = !toposort.sort();
-		topo_cell_drivers = std::move(toposort.database);
 
 		if (found_scc && toposort.analyze_loops)
 			for (auto &loop : toposort.loops) {
@@ -1043,36 +1105,141 @@ struct ShareWorker
 		return found_scc;
 	}
 
-	bool find_in_input_cone_worker(RTLIL::Cell *root, RTLIL::Cell *needle, pool<RTLIL::Cell*> &stop)
+	// The cells driving the inputs of a cell, according to the (incrementally updated) topo_index.
+	// Cells that are going to be removed are ignored.
+	void find_topo_drivers(RTLIL::Cell *cell, pool<RTLIL::Cell*> &drivers)
 	{
-		if (root == needle)
-			return true;
+		drivers.clear();
+		if (!topo_ct.cell_known(cell->type))
+			return;
+		for (auto &conn : cell->connections())
+			if (topo_ct.cell_input(cell->type, conn.first))
+				for (auto bit : conn.second)
+					for (auto &pi : topo_index->query_ports(bit))
+						if (topo_ct.cell_known(pi.cell->type) && topo_ct.cell_output(pi.cell->type, pi.port) && !cells_to_remove.count(pi.cell))
+							drivers.insert(pi.cell);
+	}
 
-		if (stop.count(root))
-			return false;
+	// Assign each cell a level that is higher than the levels of all cells driving it. A cell can only
+	// be in the input cone of cells with a higher level, which is used to prune the searches below.
+	void setup_topo_index()
+	{
+		topo_index.reset(new ModIndex(module));
+		topo_level.clear();
 
-		stop.insert(root);
+		dict<RTLIL::Cell*, int> pending_drivers;
+		dict<RTLIL::Cell*, pool<RTLIL::Cell*>> users;
+		std::vector<RTLIL::Cell*> queue;
+		pool<RTLIL::Cell*> drivers;
 
-		for (auto c : topo_cell_drivers[root])
-			if (find_in_input_cone_worker(c, needle, stop))
-				return true;
-		return false;
+		for (auto cell : module->cells()) {
+			if (!topo_ct.cell_known(cell->type))
+				continue;
+			find_topo_drivers(cell, drivers);
+			pending_drivers[cell] = GetSize(drivers);
+			for (auto c : drivers)
+				users[c].insert(cell);
+			if (drivers.empty()) {
+				topo_level[cell] = 0;
+				queue.push_back(cell);
+			}
+		}
+
+		for (int i = 0; i < GetSize(queue); i++) {
+			int level = topo_level.at(queue[i]) + 1;
+			for (auto c : users[queue[i]]) {
+				int &c_level = topo_level[c];
+				c_level = max(c_level, level);
+				if (--pending_drivers.at(c) == 0)
+					queue.push_back(c);
+			}
+		}
+
+		// Without a topological order we fall back to a full search in is_part_of_scc().
+		topo_has_scc = GetSize(queue) != GetSize(pending_drivers);
+		if (topo_has_scc)
+			topo_level.clear();
 	}
 
-	bool find_in_input_cone(RTLIL::Cell *root, RTLIL::Cell *needle)
+	// Update the levels after the cells created by make_supercell() have been committed. The new cells
+	// are the only cells without a level. The users of the merged cells now use the new cells and
+	// might need a higher level.
+	int assign_topo_level(RTLIL::Cell *cell)
 	{
-		pool<RTLIL::Cell*> stop;
-		return find_in_input_cone_worker(root, needle, stop);
+		auto it = topo_level.find(cell);
+		if (it != topo_level.end())
+			return it->second;
+
+		pool<RTLIL::Cell*> drivers;
+		find_topo_drivers(cell, drivers);
+
+		int level = 0;
+		for (auto c : drivers)
+			level = max(level, assign_topo_level(c) + 1);
+		return topo_level[cell] = level;
 	}
 
-	bool is_part_of_scc(RTLIL::Cell *cell)
+	void update_topo_levels(const pool<RTLIL::Cell*> &supercell_aux)
 	{
-		CellTypes ct;
-		ct.setup_internals();
-		ct.setup_stdcells();
+		if (topo_has_scc)
+			return;
+
+		std::vector<RTLIL::Cell*> queue;
+		for (auto c : supercell_aux) {
+			assign_topo_level(c);
+			queue.push_back(c);
+		}
+
+		while (!queue.empty())
+		{
+			RTLIL::Cell *cell = queue.back();
+			queue.pop_back();
+
+			int level = topo_level.at(cell) + 1;
+			for (auto &conn : cell->connections())
+				if (topo_ct.cell_output(cell->type, conn.first))
+					for (auto bit : conn.second)
+						for (auto &pi : topo_index->query_ports(bit)) {
+							if (!topo_ct.cell_input(pi.cell->type, pi.port) || cells_to_remove.count(pi.cell))
+								continue;
+							auto it = topo_level.find(pi.cell);
+							if (it != topo_level.end() && it->second < level) {
+								it->second = level;
+								queue.push_back(pi.cell);
+							}
+						}
+		}
+	}
+
+	bool find_in_input_cone(RTLIL::Cell *root, RTLIL::Cell *needle)
+	{
+		// is_part_of_scc() will catch this case when the supercell has been created
+		if (topo_has_scc)
+			return false;
+
+		int needle_level = topo_level.at(needle);
+		pool<RTLIL::Cell*> visited, drivers;
+		std::vector<RTLIL::Cell*> stack = { root };
+
+		while (!stack.empty())
+		{
+			RTLIL::Cell *cell = stack.back();
+			stack.pop_back();
+
+			find_topo_drivers(cell, drivers);
+			for (auto c : drivers) {
+				if (c == needle)
+					return true;
+				if (topo_level.at(c) > needle_level && visited.insert(c).second)
+					stack.push_back(c);
+			}
+		}
 
-		ModIndex mi(module);
+		return false;
+	}
 
+	bool is_part_of_scc(RTLIL::Cell *cell)
+	{
 		pool<RTLIL::Cell*> queue, covered;
 		queue.insert(cell);
 
@@ -1081,13 +1248,13 @@ struct ShareWorker
 			pool<RTLIL::Cell*> new_queue;
 
 			for (auto c : queue) {
-				if (!ct.cell_known(c->type))
+				if (!topo_ct.cell_known(c->type))
 					continue;
 				for (auto &conn : c->connections())
-					if (ct.cell_input(c->type, conn.first))
+					if (topo_ct.cell_input(c->type, conn.first))
 						for (auto bit : conn.second)
-							for (auto &pi : mi.query_ports(bit))
-								if (ct.cell_known(pi.cell->type) && ct.cell_output(pi.cell->type, pi.port))
+							for (auto &pi : topo_index->query_ports(bit))
+								if (topo_ct.cell_known(pi.cell->type) && topo_ct.cell_output(pi.cell->type, pi.port))
 									new_queue.insert(pi.cell);
 				covered.insert(c);
 			}
@@ -1106,6 +1273,82 @@ struct ShareWorker
 		return false;
 	}
 
+	// Check if the cells created by make_supercell() (the cells without a level) are part of a loop.
+	// The new cells only drive the old cells that used the outputs of the merged cells, so such a loop
+	// can only go through old cells with a level higher than that of one of the merged cells.
+	bool supercell_has_loop(RTLIL::Cell *c1, RTLIL::Cell *c2, const pool<RTLIL::Cell*> &supercell_aux)
+	{
+		if (topo_has_scc) {
+			for (auto c : supercell_aux)
+				if (is_part_of_scc(c))
+					return true;
+			return false;
+		}
+
+		int min_level = min(topo_level.at(c1), topo_level.at(c2));
+		pool<RTLIL::Cell*> new_cells, visited, drivers;
+		std::vector<RTLIL::Cell*> new_queue, stack;
+
+		for (auto c : supercell_aux)
+			if (new_cells.insert(c).second)
+				new_queue.push_back(c);
+
+		while (!new_queue.empty())
+		{
+			RTLIL::Cell *cell = new_queue.back();
+			new_queue.pop_back();
+
+			find_topo_drivers(cell, drivers);
+			for (auto c : drivers) {
+				if (!topo_level.count(c)) {
+					if (new_cells.insert(c).second)
+						new_queue.push_back(c);
+				} else if (topo_level.at(c) > min_level && visited.insert(c).second)
+					stack.push_back(c);
+			}
+		}
+
+		while (!stack.empty())
+		{
+			RTLIL::Cell *cell = stack.back();
+			stack.pop_back();
+
+			find_topo_drivers(cell, drivers);
+			for (auto c : drivers) {
+				if (!topo_level.count(c))
+					return true;
+				if (topo_level.at(c) > min_level && visited.insert(c).second)
+					stack.push_back(c);
+			}
+		}
+
+		return false;
+	}
+
+	// Run the SAT solver within the remaining SAT time budget of the pass. Returns false if the solver
+	// timed out, in which case the result is unknown.
+	bool solve_within_budget(ezSAT *ez, bool &result, const std::vector<int> &model_expressions, std::vector<bool> &model_values, int assumption = 0)
+	{
+		if (sat_budget_exhausted)
+			return false;
+
+		int64_t budget_ns = int64_t(config.sat_timeout) * 1000000000;
+		if (budget_ns > 0)
+			ez->setSolverTimeout(max(1, int((budget_ns - sat_time_ns + 999999999) / 1000000000)));
+
+		int64_t begin = PerformanceTimer::query();
+		result = ez->solve(model_expressions, model_values, assumption);
+		sat_time_ns += PerformanceTimer::query() - begin;
+
+		bool timed_out = ez->getSolverTimoutStatus();
+		if (budget_ns > 0 && (timed_out || sat_time_ns >= budget_ns)) {
+			log("SAT time budget of %d seconds exhausted, not considering any further cells for sharing.\n", config.sat_timeout);
+			sat_budget_exhausted = true;
+		}
+
+		return !timed_out;
+	}
+
 
 	// -------------
 	// Setup and run
@@ -1113,7 +1356,7 @@ struct ShareWorker
 
 	void remove_cell(Cell *cell)
 	{
-		shareable_cells.erase(cell);
+		remove_shareable_cell(cell);
 		forbidden_controls_cache.erase(cell);
 		activation_patterns_cache.erase(cell);
 		module->remove(cell);
@@ -1140,6 +1383,9 @@ struct ShareWorker
 		cone_ct.cell_types.erase(ID($shr));
 		cone_ct.cell_types.erase(ID($sshl));
 		cone_ct.cell_types.erase(ID($sshr));
+
+		topo_ct.setup_internals();
+		topo_ct.setup_stdcells();
 	}
 
 	void operator()(RTLIL::Module *module) {
@@ -1154,11 +1400,12 @@ struct ShareWorker
 
 		cells_to_remove.clear();
 		recursion_state.clear();
-		topo_cell_drivers.clear();
-		topo_bit_drivers.clear();
+		topo_level.clear();
 		exclusive_ctrls.clear();
 		terminal_bits.clear();
 		shareable_cells.clear();
+		shareable_buckets.clear();
+		shareable_signatures.clear();
 		forbidden_controls_cache.clear();
 		activation_patterns_cache.clear();
 
@@ -1178,10 +1425,12 @@ struct ShareWorker
 					if (bit < other_bit)
 						exclusive_ctrls.push_back(std::pair<RTLIL::SigBit, RTLIL::SigBit>(bit, other_bit));
 
-		while (!shareable_cells.empty() && config.limit != 0)
+		setup_topo_index();
+
+		while (!shareable_cells.empty() && config.limit != 0 && !sat_budget_exhausted)
 		{
 			RTLIL::Cell *cell = *shareable_cells.begin();
-			shareable_cells.erase(cell);
+			remove_shareable_cell(cell);
 
 			log("  Analyzing resource sharing options for %s (%s):\n", log_id(cell), log_id(cell->type));
 
@@ -1216,6 +1465,9 @@ struct ShareWorker
 
 			for (auto other_cell : candidates)
 			{
+				if (sat_budget_exhausted)
+					break;
+
 				log("    Analyzing resource sharing with %s (%s):\n", log_id(other_cell), log_id(other_cell->type));
 
 				const pool<ssc_pair_t> &other_cell_activation_patterns = find_cell_activation_patterns(other_cell, "      ");
@@ -1223,14 +1475,14 @@ struct ShareWorker
 
 				if (other_cell_activation_patterns.empty()) {
 					log("      Cell is never active. Sharing is pointless, we simply remove it.\n");
-					shareable_cells.erase(other_cell);
+					remove_shareable_cell(other_cell);
 					cells_to_remove.insert(other_cell);
 					continue;
 				}
 
 				if (other_cell_activation_patterns.count(ssc_pair_t())) {
 					log("      Cell is always active. Therefore no sharing is possible.\n");
-					shareable_cells.erase(other_cell);
+					remove_shareable_cell(other_cell);
 					continue;
 				}
 
@@ -1311,16 +1563,29 @@ struct ShareWorker
 						ez->assume(ez->NOT(ez->AND(sub1, sub2)));
 					}
 
-				if (!ez->solve(ez->expression(ez->OpOr, cell_active))) {
+				bool sat_result;
+				std::vector<bool> no_model_values;
+
+				if (!solve_within_budget(ez.get(), sat_result, {}, no_model_values, ez->expression(ez->OpOr, cell_active))) {
+					log("      SAT solver timed out.\n");
+					break;
+				}
+
+				if (!sat_result) {
 					log("      According to the SAT solver the cell %s is never active. Sharing is pointless, we simply remove it.\n", log_id(cell));
 					cells_to_remove.insert(cell);
 					break;
 				}
 
-				if (!ez->solve(ez->expression(ez->OpOr, other_cell_active))) {
+				if (!solve_within_budget(ez.get(), sat_result, {}, no_model_values, ez->expression(ez->OpOr, other_cell_active))) {
+					log("      SAT solver timed out.\n");
+					break;
+				}
+
+				if (!sat_result) {
 					log("      According to the SAT solver the cell %s is never active. Sharing is pointless, we simply remove it.\n", log_id(other_cell));
 					cells_to_remove.insert(other_cell);
-					shareable_cells.erase(other_cell);
+					remove_shareable_cell(other_cell);
 					continue;
 				}
 
@@ -1337,7 +1602,12 @@ struct ShareWorker
 				log("      Size of SAT problem: %d cells, %d variables, %d clauses\n",
 						GetSize(sat_cells), ez->numCnfVariables(), ez->numCnfClauses());
 
-				if (ez->solve(sat_model, sat_model_values)) {
+				if (!solve_within_budget(ez.get(), sat_result, sat_model, sat_model_values)) {
+					log("      SAT solver timed out.\n");
+					break;
+				}
+
+				if (sat_result) {
 					log("      According to the SAT solver this pair of cells can not be shared.\n");
 					log("      Model from SAT solver: %s = %d'", log_signal(all_ctrl_signals), GetSize(sat_model_values));
 					for (int i = GetSize(sat_model_values)-1; i >= 0; i--)
@@ -1358,7 +1628,7 @@ struct ShareWorker
 					continue;
 				}
 
-				shareable_cells.erase(other_cell);
+				remove_shareable_cell(other_cell);
 
 				int cell_select_score = 0;
 				int other_cell_select_score = 0;
@@ -1386,16 +1656,11 @@ struct ShareWorker
 				cells_to_remove.insert(cell);
 				cells_to_remove.insert(other_cell);
 
-				for (auto c : supercell_aux)
-					if (is_part_of_scc(c))
-						goto do_rollback;
-
-				if (0) {
-			do_rollback:
+				if (supercell_has_loop(cell, other_cell, supercell_aux)) {
 					log("      New topology contains loops! Rolling back..\n");
 					cells_to_remove.erase(cell);
 					cells_to_remove.erase(other_cell);
-					shareable_cells.insert(other_cell);
+					add_shareable_cell(other_cell);
 					for (auto cc : supercell_aux)
 						remove_cell(cc);
 					continue;
@@ -1406,17 +1671,8 @@ struct ShareWorker
 				supercell_activation_patterns.insert(filtered_other_cell_activation_patterns.begin(), filtered_other_cell_activation_patterns.end());
 				optimize_activation_patterns(supercell_activation_patterns);
 				activation_patterns_cache[supercell] = supercell_activation_patterns;
-				shareable_cells.insert(supercell);
-
-				for (auto bit : topo_sigmap(all_ctrl_signals))
-					for (auto c : topo_bit_drivers[bit])
-						topo_cell_drivers[supercell].insert(c);
-
-				topo_cell_drivers[supercell].insert(topo_cell_drivers[cell].begin(), topo_cell_drivers[cell].end());
-				topo_cell_drivers[supercell].insert(topo_cell_drivers[other_cell].begin(), topo_cell_drivers[other_cell].end());
-
-				topo_cell_drivers[cell] = { supercell };
-				topo_cell_drivers[other_cell] = { supercell };
+				add_shareable_cell(supercell);
+				update_topo_levels(supercell_aux);
 
 				if (limit > 0)
 					limit--;
@@ -1425,6 +1681,9 @@ struct ShareWorker
 			}
 		}
 
+		topo_index.reset();
+		topo_level.clear();
+
 		if (!cells_to_remove.empty()) {
 			log("Removing %d cells in module %s:\n", GetSize(cells_to_remove), log_id(module));
 			for (auto c : cells_to_remove) {
@@ -1475,6 +1734,11 @@ struct SharePass : public Pass {
 		log("  -limit N\n");
 		log("    Only perform the first N merges, then stop. This is useful for debugging.\n");
 		log("\n");
+		log("  -timeout <seconds>\n");
+		log("    Limit the total CPU time spent in the SAT solver by this pass. When the\n");
+		log("    limit is reached, the pair of cells that is being analyzed is not shared\n");
+		log("    and no further cells are considered for sharing.\n");
+		log("\n");
 	}
 	void execute(std::vector<std::string> args, RTLIL::Design *design) override
 	{
@@ -1484,6 +1748,7 @@ struct SharePass : public Pass {
 		config.opt_force = false;
 		config.opt_aggressive = false;
 		config.opt_fast = false;
+		config.sat_timeout = 0;
 
 		config.generic_uni_ops.insert(ID($not));
 		// config.generic_uni_ops.insert(ID($pos));
@@ -1545,6 +1810,10 @@ struct SharePass : public Pass {
 				config.limit = atoi(args[++argidx].c_str());
 				continue;
 			}
+			if (args[argidx] == "-timeout" && argidx+1 < args.size()) {
+				config.sat_timeout = atoi(args[++argidx].c_str());
+				continue;
+			}
 			break;
 		}
 		extra_args(args, argidx, design);
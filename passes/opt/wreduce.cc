@@ -21,6 +21,7 @@
 #include "kernel/sigtools.h"
 #include "kernel/modtools.h"
 #include "kernel/ffinit.h"
+#include "kernel/modcache.h"
 
 USING_YOSYS_NAMESPACE
 
@@ -30,6 +31,7 @@ struct WreduceConfig
 {
 	pool<IdString> supported_cell_types;
 	bool keepdc = false;
+	bool memx = false;
 
 	WreduceConfig()
 	{
@@ -50,33 +52,57 @@ struct WreduceWorker
 {
 	WreduceConfig *config;
 	Module *module;
-	ModIndex mi;
+	std::unique_ptr<ModIndex> mi;
 
 	std::set<Cell*, IdString::compare_ptr_by_name<Cell>> work_queue_cells;
 	std::set<SigBit> work_queue_bits;
 	pool<SigBit> keep_bits;
+	SigMap init_attr_sigmap;
 	FfInitVals initvals;
 
 	WreduceWorker(WreduceConfig *config, Module *module) :
-			config(config), module(module), mi(module) { }
+			config(config), module(module) { }
 
-	void run_cell_mux(Cell *cell)
+	SigSpec sigmap(const SigSpec &sig) const
+	{
+		return mi->sigmap(sig);
+	}
+
+	// whether the (mapped) bit is driven by a cell port and not used anywhere else
+	bool unused_bit(SigBit bit) const
+	{
+		auto info = mi->query(bit);
+		return info != nullptr && !info->is_output && GetSize(info->ports) <= 1 && !keep_bits.count(bit);
+	}
+
+	// whether the bit is connected to a cell or a module port
+	bool connected_bit(SigBit bit) const
+	{
+		auto info = mi->query(bit);
+		return info && (info->is_input || info->is_output || GetSize(info->ports) > 0);
+	}
+
+	State init_value(SigBit bit) const
+	{
+		return initvals(bit);
+	}
+
+	bool run_cell_mux(Cell *cell)
 	{
 		// Reduce size of MUX if inputs agree on a value for a bit or a output bit is unused
 
-		SigSpec sig_a = mi.sigmap(cell->getPort(ID::A));
-		SigSpec sig_b = mi.sigmap(cell->getPort(ID::B));
-		SigSpec sig_s = mi.sigmap(cell->getPort(ID::S));
-		SigSpec sig_y = mi.sigmap(cell->getPort(ID::Y));
+		SigSpec sig_a = sigmap(cell->getPort(ID::A));
+		SigSpec sig_b = sigmap(cell->getPort(ID::B));
+		SigSpec sig_s = sigmap(cell->getPort(ID::S));
+		SigSpec sig_y = sigmap(cell->getPort(ID::Y));
 		std::vector<SigBit> bits_removed;
 
 		if (sig_y.has_const())
-			return;
+			return false;
 
 		for (int i = GetSize(sig_y)-1; i >= 0; i--)
 		{
-			auto info = mi.query(sig_y[i]);
-			if (!info->is_output && GetSize(info->ports) <= 1 && !keep_bits.count(mi.sigmap(sig_y[i]))) {
+			if (unused_bit(sig_y[i])) {
 				bits_removed.push_back(State::Sx);
 				continue;
 			}
@@ -95,7 +121,8 @@ struct WreduceWorker
 		}
 
 		if (bits_removed.empty())
-			return;
+			return false;
+
 
 		SigSpec sig_removed;
 		for (int i = GetSize(bits_removed)-1; i >= 0; i--)
@@ -105,7 +132,7 @@ struct WreduceWorker
 			log("Removed cell %s.%s (%s).\n", log_id(module), log_id(cell), log_id(cell->type));
 			module->connect(sig_y, sig_removed);
 			module->remove(cell);
-			return;
+			return true;
 		}
 
 		log("Removed top %d bits (of %d) from mux cell %s.%s (%s).\n",
@@ -136,21 +163,22 @@ struct WreduceWorker
 		cell->fixup_parameters();
 
 		module->connect(sig_y.extract(n_kept, n_removed), sig_removed);
+		return true;
 	}
 
-	void run_cell_dff(Cell *cell)
+	bool run_cell_dff(Cell *cell)
 	{
 		// Reduce size of FF if inputs are just sign/zero extended or output bit is not used
 
-		SigSpec sig_d = mi.sigmap(cell->getPort(ID::D));
-		SigSpec sig_q = mi.sigmap(cell->getPort(ID::Q));
+		SigSpec sig_d = sigmap(cell->getPort(ID::D));
+		SigSpec sig_q = sigmap(cell->getPort(ID::Q));
 		bool has_reset = false;
-		Const initval = initvals(sig_q), rst_value;
+		Const rst_value;
 
 		int width_before = GetSize(sig_q);
 
 		if (width_before == 0)
-			return;
+			return false;
 
 		if (cell->parameters.count(ID::ARST_VALUE)) {
 			rst_value = cell->parameters[ID::ARST_VALUE];
@@ -165,7 +193,9 @@ struct WreduceWorker
 
 		for (int i = GetSize(sig_q)-1; i >= 0; i--)
 		{
-			if (zero_ext && sig_d[i] == State::S0 && (initval[i] == State::S0 || initval[i] == State::Sx) &&
+			State init_i = init_value(sig_q[i]);
+
+			if (zero_ext && sig_d[i] == State::S0 && (init_i == State::S0 || init_i == State::Sx) &&
 					(!has_reset || i >= GetSize(rst_value) || rst_value[i] == State::S0 || rst_value[i] == State::Sx)) {
 				module->connect(sig_q[i], State::S0);
 				initvals.remove_init(sig_q[i]);
@@ -174,7 +204,7 @@ struct WreduceWorker
 				continue;
 			}
 
-			if (sign_ext && i > 0 && sig_d[i] == sig_d[i-1] && initval[i] == initval[i-1] &&
+			if (sign_ext && i > 0 && sig_d[i] == sig_d[i-1] && init_i == init_value(sig_q[i-1]) &&
 					(!has_reset || i >= GetSize(rst_value) || rst_value[i] == rst_value[i-1])) {
 				module->connect(sig_q[i], sig_q[i-1]);
 				initvals.remove_init(sig_q[i]);
@@ -183,10 +213,9 @@ struct WreduceWorker
 				continue;
 			}
 
-			auto info = mi.query(sig_q[i]);
-			if (info == nullptr)
-				return;
-			if (!info->is_output && GetSize(info->ports) == 1 && !keep_bits.count(mi.sigmap(sig_q[i]))) {
+			if (sig_q[i].wire == nullptr)
+				return width_before != GetSize(sig_q);
+			if (unused_bit(sig_q[i])) {
 				initvals.remove_init(sig_q[i]);
 				sig_d.remove(i);
 				sig_q.remove(i);
@@ -199,12 +228,12 @@ struct WreduceWorker
 		}
 
 		if (width_before == GetSize(sig_q))
-			return;
+			return false;
 
 		if (GetSize(sig_q) == 0) {
 			log("Removed cell %s.%s (%s).\n", log_id(module), log_id(cell), log_id(cell->type));
 			module->remove(cell);
-			return;
+			return true;
 		}
 
 		log("Removed top %d bits (of %d) from FF cell %s.%s (%s).\n", width_before - GetSize(sig_q), width_before,
@@ -228,12 +257,13 @@ struct WreduceWorker
 		cell->setPort(ID::D, sig_d);
 		cell->setPort(ID::Q, sig_q);
 		cell->fixup_parameters();
+		return true;
 	}
 
 	void run_reduce_inport(Cell *cell, char port, int max_port_size, bool &port_signed, bool &did_something)
 	{
-		port_signed = cell->getParam(stringf("\\%c_SIGNED", port)).as_bool();
-		SigSpec sig = mi.sigmap(cell->getPort(stringf("\\%c", port)));
+		port_signed = cell->getParam(port == 'A' ? ID::A_SIGNED : ID::B_SIGNED).as_bool();
+		SigSpec sig = sigmap(cell->getPort(port == 'A' ? ID::A : ID::B));
 
 		if (port == 'B' && cell->type.in(ID($shl), ID($shr), ID($sshl), ID($sshr)))
 			port_signed = false;
@@ -255,19 +285,19 @@ struct WreduceWorker
 		}
 
 		if (bits_removed) {
+			did_something = true;
 			log("Removed top %d bits (of %d) from port %c of cell %s.%s (%s).\n",
 					bits_removed, GetSize(sig) + bits_removed, port, log_id(module), log_id(cell), log_id(cell->type));
-			cell->setPort(stringf("\\%c", port), sig);
-			did_something = true;
+			cell->setPort(port == 'A' ? ID::A : ID::B, sig);
 		}
 	}
 
-	void run_cell(Cell *cell)
+	bool run_cell(Cell *cell)
 	{
 		bool did_something = false;
 
 		if (!cell->type.in(config->supported_cell_types))
-			return;
+			return false;
 
 		if (cell->type.in(ID($mux), ID($pmux)))
 			return run_cell_mux(cell);
@@ -275,10 +305,10 @@ struct WreduceWorker
 		if (cell->type.in(ID($dff), ID($dffe), ID($adff), ID($adffe), ID($sdff), ID($sdffe), ID($sdffce), ID($dlatch), ID($adlatch)))
 			return run_cell_dff(cell);
 
-		SigSpec sig = mi.sigmap(cell->getPort(ID::Y));
+		SigSpec sig = sigmap(cell->getPort(ID::Y));
 
 		if (sig.has_const())
-			return;
+			return false;
 
 
 		// Reduce size of ports A and B based on constant input bits and size of output port
@@ -301,7 +331,7 @@ struct WreduceWorker
 			run_reduce_inport(cell, 'B', max_port_b_size, port_b_signed, did_something);
 
 		if (cell->hasPort(ID::A) && cell->hasPort(ID::B) && port_a_signed && port_b_signed) {
-			SigSpec sig_a = mi.sigmap(cell->getPort(ID::A)), sig_b = mi.sigmap(cell->getPort(ID::B));
+			SigSpec sig_a = sigmap(cell->getPort(ID::A)), sig_b = sigmap(cell->getPort(ID::B));
 			if (GetSize(sig_a) > 0 && sig_a[GetSize(sig_a)-1] == State::S0 &&
 					GetSize(sig_b) > 0 && sig_b[GetSize(sig_b)-1] == State::S0) {
 				log("Converting cell %s.%s (%s) from signed to unsigned.\n",
@@ -315,7 +345,7 @@ struct WreduceWorker
 		}
 
 		if (cell->hasPort(ID::A) && !cell->hasPort(ID::B) && port_a_signed) {
-			SigSpec sig_a = mi.sigmap(cell->getPort(ID::A));
+			SigSpec sig_a = sigmap(cell->getPort(ID::A));
 			if (GetSize(sig_a) > 0 && sig_a[GetSize(sig_a)-1] == State::S0) {
 				log("Converting cell %s.%s (%s) from signed to unsigned.\n",
 						log_id(module), log_id(cell), log_id(cell->type));
@@ -332,16 +362,7 @@ struct WreduceWorker
 		if (port_a_signed && cell->type == ID($shr)) {
 			// do not reduce size of output on $shr cells with signed A inputs
 		} else {
-			while (GetSize(sig) > 0)
-			{
-				auto bit = sig[GetSize(sig)-1];
-				if (keep_bits.count(bit))
-					break;
-
-				auto info = mi.query(bit);
-				if (info->is_output || GetSize(info->ports) > 1)
-					break;
-
+			while (GetSize(sig) > 0 && unused_bit(sig[GetSize(sig)-1])) {
 				sig.remove(GetSize(sig)-1);
 				bits_removed++;
 			}
@@ -373,7 +394,7 @@ struct WreduceWorker
 		if (GetSize(sig) == 0) {
 			log("Removed cell %s.%s (%s).\n", log_id(module), log_id(cell), log_id(cell->type));
 			module->remove(cell);
-			return;
+			return true;
 		}
 
 		if (bits_removed) {
@@ -387,6 +408,83 @@ struct WreduceWorker
 			cell->fixup_parameters();
 			run_cell(cell);
 		}
+		return did_something;
+	}
+
+	// Rewrites that are applied to all selected cells before the work queue runs.
+	bool run_cell_prepass(Cell *c)
+	{
+		bool did_something = false;
+
+		if (c->type.in(ID($reduce_and), ID($reduce_or), ID($reduce_xor), ID($reduce_xnor), ID($reduce_bool),
+				ID($lt), ID($le), ID($eq), ID($ne), ID($eqx), ID($nex), ID($ge), ID($gt),
+				ID($logic_not), ID($logic_and), ID($logic_or)) && GetSize(c->getPort(ID::Y)) > 1) {
+			SigSpec sig = c->getPort(ID::Y);
+			if (!sig.has_const()) {
+				c->setPort(ID::Y, sig[0]);
+				c->setParam(ID::Y_WIDTH, 1);
+				sig.remove(0);
+				module->connect(sig, Const(0, GetSize(sig)));
+				did_something = true;
+			}
+		}
+
+		if (c->type.in(ID($div), ID($mod), ID($divfloor), ID($modfloor), ID($pow)))
+		{
+			SigSpec A = c->getPort(ID::A);
+			int original_a_width = GetSize(A);
+			if (c->getParam(ID::A_SIGNED).as_bool()) {
+				while (GetSize(A) > 1 && A[GetSize(A)-1] == State::S0 && A[GetSize(A)-2] == State::S0)
+					A.remove(GetSize(A)-1, 1);
+			} else {
+				while (GetSize(A) > 0 && A[GetSize(A)-1] == State::S0)
+					A.remove(GetSize(A)-1, 1);
+			}
+			if (original_a_width != GetSize(A)) {
+				log("Removed top %d bits (of %d) from port A of cell %s.%s (%s).\n",
+						original_a_width-GetSize(A), original_a_width, log_id(module), log_id(c), log_id(c->type));
+				c->setPort(ID::A, A);
+				c->setParam(ID::A_WIDTH, GetSize(A));
+				did_something = true;
+			}
+
+			SigSpec B = c->getPort(ID::B);
+			int original_b_width = GetSize(B);
+			if (c->getParam(ID::B_SIGNED).as_bool()) {
+				while (GetSize(B) > 1 && B[GetSize(B)-1] == State::S0 && B[GetSize(B)-2] == State::S0)
+					B.remove(GetSize(B)-1, 1);
+			} else {
+				while (GetSize(B) > 0 && B[GetSize(B)-1] == State::S0)
+					B.remove(GetSize(B)-1, 1);
+			}
+			if (original_b_width != GetSize(B)) {
+				log("Removed top %d bits (of %d) from port B of cell %s.%s (%s).\n",
+						original_b_width-GetSize(B), original_b_width, log_id(module), log_id(c), log_id(c->type));
+				c->setPort(ID::B, B);
+				c->setParam(ID::B_WIDTH, GetSize(B));
+				did_something = true;
+			}
+		}
+
+		if (!config->memx && c->type.in(ID($memrd), ID($memwr), ID($meminit))) {
+			IdString memid = c->getParam(ID::MEMID).decode_string();
+			RTLIL::Memory *mem = module->memories.at(memid);
+			if (mem->start_offset >= 0) {
+				int cur_addrbits = c->getParam(ID::ABITS).as_int();
+				int max_addrbits = ceil_log2(mem->start_offset + mem->size);
+				if (cur_addrbits > max_addrbits) {
+					log("Removed top %d address bits (of %d) from memory %s port %s.%s (%s).\n",
+							cur_addrbits-max_addrbits, cur_addrbits,
+							c->type == ID($memrd) ? "read" : c->type == ID($memwr) ? "write" : "init",
+							log_id(module), log_id(c), log_id(memid));
+					c->setParam(ID::ABITS, max_addrbits);
+					c->setPort(ID::ADDR, c->getPort(ID::ADDR).extract(0, max_addrbits));
+					did_something = true;
+				}
+			}
+		}
+
+		return did_something;
 	}
 
 	static int count_nontrivial_wire_attrs(RTLIL::Wire *w)
@@ -397,15 +495,24 @@ struct WreduceWorker
 		return count;
 	}
 
-	void run()
+	// Returns whether anything was changed.
+	bool run()
 	{
-		// create a copy as mi.sigmap will be updated as we process the module
-		SigMap init_attr_sigmap = mi.sigmap;
+		bool did_something = false;
+
+		for (auto c : module->selected_cells())
+			if (run_cell_prepass(c))
+				did_something = true;
+
+		mi.reset(new ModIndex(module));
+
+		// create a copy as mi->sigmap will be updated as we process the module
+		init_attr_sigmap = mi->sigmap;
 		initvals.set(&init_attr_sigmap, module);
 
 		for (auto w : module->wires()) {
 			if (w->get_bool_attribute(ID::keep))
-				for (auto bit : mi.sigmap(w))
+				for (auto bit : mi->sigmap(w))
 					keep_bits.insert(bit);
 		}
 
@@ -416,18 +523,17 @@ struct WreduceWorker
 		{
 			work_queue_bits.clear();
 			for (auto c : work_queue_cells)
-				run_cell(c);
+				if (run_cell(c))
+					did_something = true;
 
 			work_queue_cells.clear();
 			for (auto bit : work_queue_bits)
-			for (auto port : mi.query_ports(bit))
+			for (auto port : mi->query_ports(bit))
 				if (module->selected(port.cell))
 					work_queue_cells.insert(port.cell);
 		}
 
 		pool<SigSpec> complete_wires;
-		for (auto w : module->wires())
-			complete_wires.insert(mi.sigmap(w));
 
 		for (auto w : module->selected_wires())
 		{
@@ -437,9 +543,7 @@ struct WreduceWorker
 				continue;
 
 			for (int i = GetSize(w)-1; i >= 0; i--) {
-				SigBit bit(w, i);
-				auto info = mi.query(bit);
-				if (info && (info->is_input || info->is_output || GetSize(info->ports) > 0))
+				if (connected_bit(SigBit(w, i)))
 					break;
 				unused_top_bits++;
 			}
@@ -447,18 +551,29 @@ struct WreduceWorker
 			if (unused_top_bits == 0 || unused_top_bits == GetSize(w))
 				continue;
 
-			if (complete_wires[mi.sigmap(w).extract(0, GetSize(w) - unused_top_bits)])
+			if (complete_wires.empty())
+				for (auto w2 : module->wires())
+					complete_wires.insert(sigmap(w2));
+
+			if (complete_wires[sigmap(w).extract(0, GetSize(w) - unused_top_bits)])
 				continue;
 
+
 			log("Removed top %d bits (of %d) from wire %s.%s.\n", unused_top_bits, GetSize(w), log_id(module), log_id(w));
 			Wire *nw = module->addWire(NEW_ID, GetSize(w) - unused_top_bits);
 			module->connect(nw, SigSpec(w).extract(0, GetSize(nw)));
 			module->swap_names(w, nw);
+			did_something = true;
 		}
+
+		return did_something;
 	}
 };
 
 struct WreducePass : public Pass {
+	// The modules in which nothing could be reduced, see kernel/modcache.h.
+	ModuleCache<bool> clean_modules;
+
 	WreducePass() : Pass("wreduce", "reduce the word size of operations if possible") { }
 	void help() override
 	{
@@ -482,18 +597,20 @@ struct WreducePass : public Pass {
 		log("    -keepdc\n");
 		log("        Do not optimize explicit don't-care values.\n");
 		log("\n");
+		log("Modules in which nothing can be reduced are remembered, and are not checked\n");
+		log("again by later calls of this command until they are changed.\n");
+		log("\n");
 	}
 	void execute(std::vector<std::string> args, Design *design) override
 	{
 		WreduceConfig config;
-		bool opt_memx = false;
 
 		log_header(design, "Executing WREDUCE pass (reducing word size of cells).\n");
 
 		size_t argidx;
 		for (argidx = 1; argidx < args.size(); argidx++) {
 			if (args[argidx] == "-memx") {
-				opt_memx = true;
+				config.memx = true;
 				continue;
 			}
 			if (args[argidx] == "-keepdc") {
@@ -504,81 +621,32 @@ struct WreducePass : public Pass {
 		}
 		extra_args(args, argidx, design);
 
+		std::string options = stringf("%d %d", config.memx, config.keepdc);
+		clean_modules.prune(design);
+
+		int clean_count = 0, cached_count = 0;
 		for (auto module : design->selected_modules())
 		{
 			if (module->has_processes_warn())
 				continue;
 
-			for (auto c : module->selected_cells())
-			{
-				if (c->type.in(ID($reduce_and), ID($reduce_or), ID($reduce_xor), ID($reduce_xnor), ID($reduce_bool),
-						ID($lt), ID($le), ID($eq), ID($ne), ID($eqx), ID($nex), ID($ge), ID($gt),
-						ID($logic_not), ID($logic_and), ID($logic_or)) && GetSize(c->getPort(ID::Y)) > 1) {
-					SigSpec sig = c->getPort(ID::Y);
-					if (!sig.has_const()) {
-						c->setPort(ID::Y, sig[0]);
-						c->setParam(ID::Y_WIDTH, 1);
-						sig.remove(0);
-						module->connect(sig, Const(0, GetSize(sig)));
-					}
-				}
-
-				if (c->type.in(ID($div), ID($mod), ID($divfloor), ID($modfloor), ID($pow)))
-				{
-					SigSpec A = c->getPort(ID::A);
-					int original_a_width = GetSize(A);
-					if (c->getParam(ID::A_SIGNED).as_bool()) {
-						while (GetSize(A) > 1 && A[GetSize(A)-1] == State::S0 && A[GetSize(A)-2] == State::S0)
-							A.remove(GetSize(A)-1, 1);
-					} else {
-						while (GetSize(A) > 0 && A[GetSize(A)-1] == State::S0)
-							A.remove(GetSize(A)-1, 1);
-					}
-					if (original_a_width != GetSize(A)) {
-						log("Removed top %d bits (of %d) from port A of cell %s.%s (%s).\n",
-								original_a_width-GetSize(A), original_a_width, log_id(module), log_id(c), log_id(c->type));
-						c->setPort(ID::A, A);
-						c->setParam(ID::A_WIDTH, GetSize(A));
-					}
-
-					SigSpec B = c->getPort(ID::B);
-					int original_b_width = GetSize(B);
-					if (c->getParam(ID::B_SIGNED).as_bool()) {
-						while (GetSize(B) > 1 && B[GetSize(B)-1] == State::S0 && B[GetSize(B)-2] == State::S0)
-							B.remove(GetSize(B)-1, 1);
-					} else {
-						while (GetSize(B) > 0 && B[GetSize(B)-1] == State::S0)
-							B.remove(GetSize(B)-1, 1);
-					}
-					if (original_b_width != GetSize(B)) {
-						log("Removed top %d bits (of %d) from port B of cell %s.%s (%s).\n",
-								original_b_width-GetSize(B), original_b_width, log_id(module), log_id(c), log_id(c->type));
-						c->setPort(ID::B, B);
-						c->setParam(ID::B_WIDTH, GetSize(B));
-					}
-				}
-
-				if (!opt_memx && c->type.in(ID($memrd), ID($memwr), ID($meminit))) {
-					IdString memid = c->getParam(ID::MEMID).decode_string();
-					RTLIL::Memory *mem = module->memories.at(memid);
-					if (mem->start_offset >= 0) {
-						int cur_addrbits = c->getParam(ID::ABITS).as_int();
-						int max_addrbits = ceil_log2(mem->start_offset + mem->size);
-						if (cur_addrbits > max_addrbits) {
-							log("Removed top %d address bits (of %d) from memory %s port %s.%s (%s).\n",
-									cur_addrbits-max_addrbits, cur_addrbits,
-									c->type == ID($memrd) ? "read" : c->type == ID($memwr) ? "write" : "init",
-									log_id(module), log_id(c), log_id(memid));
-							c->setParam(ID::ABITS, max_addrbits);
-							c->setPort(ID::ADDR, c->getPort(ID::ADDR).extract(0, max_addrbits));
-						}
-					}
-				}
+			if (clean_modules.lookup(module, options)) {
+				cached_count++;
+				continue;
 			}
 
 			WreduceWorker worker(&config, module);
-			worker.run();
+			if (!worker.run()) {
+				// a partial selection may have hidden cells that can be reduced
+				if (design->selected_whole_module(module->name))
+					clean_modules.insert(module, options, true);
+				clean_count++;
+			}
 		}
+
+		if (clean_count + cached_count > 0)
+			log("Nothing to reduce in %d modules (%d of them unchanged since the last call).\n",
+					clean_count + cached_count, cached_count);
 	}
 } WreducePass;
 
@@ -40,12 +40,6 @@ IdString concat_name(RTLIL::Cell *cell, IdString object_name)
 	}
 }
 
-template<class T>
-IdString map_name(RTLIL::Cell *cell, T *object)
-{
-	return cell->module->uniquify(concat_name(cell, object->name));
-}
-
 template<class T>
 void map_attributes(RTLIL::Cell *cell, T *object, IdString orig_object_name)
 {
@@ -73,31 +67,158 @@ void map_sigspec(const dict<RTLIL::Wire*, RTLIL::Wire*> &map, RTLIL::SigSpec &si
 	sig = chunks;
 }
 
+// Everything about a module that is needed to instantiate it, and that does not depend on the instance.
+// This is computed once per module and shared by all of its instances, so that flattening many instances
+// of the same module does not repeatedly analyze it or build the names of its objects from scratch.
+struct FlattenTemplate
+{
+	// The name of an object of the template, split into the part that is appended to the instance name
+	// prefix, and the hierarchical name that is appended to the instance hdlname.
+	struct ObjectName {
+		std::string suffix;
+		bool is_public = false;
+		bool has_hdlname = false;
+		std::string hdlname;
+	};
+
+	dict<IdString, IdString> positional_ports;
+	pool<SigBit> tpl_driven;
+
+	std::vector<RTLIL::Memory*> memories;
+	std::vector<RTLIL::Wire*> wires;
+	std::vector<RTLIL::Process*> processes;
+	std::vector<RTLIL::Cell*> cells;
+	std::vector<ObjectName> memory_names, wire_names, process_names, cell_names;
+
+	template<class T>
+	static ObjectName object_name(T *object)
+	{
+		ObjectName name;
+		name.is_public = object->name[0] == '\\';
+		if (name.is_public)
+			name.suffix = object->name.c_str() + 1;
+		else if (object->name.begins_with("$flatten"))
+			name.suffix = object->name.substr(8);
+		else
+			name.suffix = object->name.str();
+		if (object->has_attribute(ID::hdlname) || name.is_public) {
+			name.has_hdlname = true;
+			std::vector<std::string> hierarchy;
+			if (object->has_attribute(ID::hdlname))
+				hierarchy = object->get_hdlname_attribute();
+			else
+				hierarchy.push_back(name.suffix);
+			for (auto &ident : hierarchy)
+				name.hdlname += " " + ident;
+		}
+		return name;
+	}
+
+	FlattenTemplate(RTLIL::Module *tpl)
+	{
+		for (auto &it : tpl->memories) {
+			memories.push_back(it.second);
+			memory_names.push_back(object_name(it.second));
+		}
+		for (auto wire : tpl->wires()) {
+			if (wire->port_id > 0)
+				positional_ports.emplace(stringf("$%d", wire->port_id), wire->name);
+			wires.push_back(wire);
+			wire_names.push_back(object_name(wire));
+		}
+		for (auto &it : tpl->processes) {
+			processes.push_back(it.second);
+			process_names.push_back(object_name(it.second));
+		}
+		for (auto cell : tpl->cells()) {
+			cells.push_back(cell);
+			cell_names.push_back(object_name(cell));
+			for (auto &conn : cell->connections())
+				if (cell->output(conn.first))
+					for (auto bit : conn.second)
+						tpl_driven.insert(bit);
+		}
+		for (auto &conn : tpl->connections())
+			for (auto bit : conn.first)
+				tpl_driven.insert(bit);
+	}
+};
+
+// The parts of the names of flattened objects that depend on the instance.
+struct FlattenInstance
+{
+	RTLIL::Cell *cell;
+	std::string public_prefix, private_prefix, hdlname_prefix;
+	pool<std::string> src;
+
+	FlattenInstance(RTLIL::Cell *cell) : cell(cell)
+	{
+		public_prefix = cell->name.str() + ".";
+		private_prefix = "$flatten" + public_prefix;
+		if (cell->name[0] == '\\')
+			hdlname_prefix = cell->name.c_str() + 1;
+		src = cell->get_strpool_attribute(ID::src);
+	}
+
+	IdString name(const FlattenTemplate::ObjectName &name) const
+	{
+		return (name.is_public ? public_prefix : private_prefix) + name.suffix;
+	}
+
+	IdString map_name(const FlattenTemplate::ObjectName &name) const
+	{
+		return cell->module->uniquify(this->name(name));
+	}
+
+	template<class T>
+	void map_attributes(T *object, const FlattenTemplate::ObjectName &name) const
+	{
+		if (object->has_attribute(ID::src))
+			object->add_strpool_attribute(ID::src, src);
+		if (!hdlname_prefix.empty() && name.has_hdlname)
+			object->set_string_attribute(ID::hdlname, hdlname_prefix + name.hdlname);
+	}
+};
+
 struct FlattenWorker
 {
 	bool ignore_wb = false;
 
-	void flatten_cell(RTLIL::Design *design, RTLIL::Module *module, RTLIL::Cell *cell, RTLIL::Module *tpl, std::vector<RTLIL::Cell*> &new_cells)
+	dict<RTLIL::Module*, std::unique_ptr<FlattenTemplate>> templates;
+
+	const FlattenTemplate &get_template(RTLIL::Module *tpl)
+	{
+		auto &entry = templates[tpl];
+		if (entry == nullptr)
+			entry.reset(new FlattenTemplate(tpl));
+		return *entry;
+	}
+
+	void flatten_cell(RTLIL::Design *design, RTLIL::Module *module, RTLIL::Cell *cell, RTLIL::Module *tpl, SigMap &sigmap, std::vector<RTLIL::Cell*> &new_cells)
 	{
+		const FlattenTemplate &flat_tpl = get_template(tpl);
+		const FlattenInstance inst(cell);
+
 		// Copy the contents of the flattened cell
 
 		dict<IdString, IdString> memory_map;
-		for (auto &tpl_memory_it : tpl->memories) {
-			RTLIL::Memory *new_memory = module->addMemory(map_name(cell, tpl_memory_it.second), tpl_memory_it.second);
-			map_attributes(cell, new_memory, tpl_memory_it.second->name);
-			memory_map[tpl_memory_it.first] = new_memory->name;
+		for (int i = 0; i < GetSize(flat_tpl.memories); i++) {
+			RTLIL::Memory *tpl_memory = flat_tpl.memories[i];
+			RTLIL::Memory *new_memory = module->addMemory(inst.map_name(flat_tpl.memory_names[i]), tpl_memory);
+			inst.map_attributes(new_memory, flat_tpl.memory_names[i]);
+			memory_map[tpl_memory->name] = new_memory->name;
 			design->select(module, new_memory);
 		}
 
 		dict<RTLIL::Wire*, RTLIL::Wire*> wire_map;
-		dict<IdString, IdString> positional_ports;
-		for (auto tpl_wire : tpl->wires()) {
-			if (tpl_wire->port_id > 0)
-				positional_ports.emplace(stringf("$%d", tpl_wire->port_id), tpl_wire->name);
+		const dict<IdString, IdString> &positional_ports = flat_tpl.positional_ports;
+		for (int i = 0; i < GetSize(flat_tpl.wires); i++) {
+			RTLIL::Wire *tpl_wire = flat_tpl.wires[i];
+			const FlattenTemplate::ObjectName &tpl_wire_name = flat_tpl.wire_names[i];
 
 			RTLIL::Wire *new_wire = nullptr;
-			if (tpl_wire->name[0] == '\\') {
-				RTLIL::Wire *hier_wire = module->wire(concat_name(cell, tpl_wire->name));
+			if (tpl_wire_name.is_public) {
+				RTLIL::Wire *hier_wire = module->wire(inst.name(tpl_wire_name));
 				if (hier_wire != nullptr && hier_wire->get_bool_attribute(ID::hierconn)) {
 					hier_wire->attributes.erase(ID::hierconn);
 					if (GetSize(hier_wire) < GetSize(tpl_wire)) {
@@ -105,23 +226,24 @@ struct FlattenWorker
 							log_id(module), log_id(hier_wire), log_id(tpl), log_id(tpl_wire), log_id(module), log_id(cell));
 						hier_wire->width = GetSize(tpl_wire);
 					}
+					map_attributes(cell, hier_wire, tpl_wire->name);
 					new_wire = hier_wire;
 				}
 			}
 			if (new_wire == nullptr) {
-				new_wire = module->addWire(map_name(cell, tpl_wire), tpl_wire);
+				new_wire = module->addWire(inst.map_name(tpl_wire_name), tpl_wire);
 				new_wire->port_input = new_wire->port_output = false;
 				new_wire->port_id = false;
+				inst.map_attributes(new_wire, tpl_wire_name);
 			}
 
-			map_attributes(cell, new_wire, tpl_wire->name);
 			wire_map[tpl_wire] = new_wire;
 			design->select(module, new_wire);
 		}
 
-		for (auto &tpl_proc_it : tpl->processes) {
-			RTLIL::Process *new_proc = module->addProcess(map_name(cell, tpl_proc_it.second), tpl_proc_it.second);
-			map_attributes(cell, new_proc, tpl_proc_it.second->name);
+		for (int i = 0; i < GetSize(flat_tpl.processes); i++) {
+			RTLIL::Process *new_proc = module->addProcess(inst.map_name(flat_tpl.process_names[i]), flat_tpl.processes[i]);
+			inst.map_attributes(new_proc, flat_tpl.process_names[i]);
 			for (auto new_proc_sync : new_proc->syncs)
 				for (auto &memwr_action : new_proc_sync->mem_write_actions)
 					memwr_action.memid = memory_map.at(memwr_action.memid).str();
@@ -130,9 +252,9 @@ struct FlattenWorker
 			design->select(module, new_proc);
 		}
 
-		for (auto tpl_cell : tpl->cells()) {
-			RTLIL::Cell *new_cell = module->addCell(map_name(cell, tpl_cell), tpl_cell);
-			map_attributes(cell, new_cell, tpl_cell->name);
+		for (int i = 0; i < GetSize(flat_tpl.cells); i++) {
+			RTLIL::Cell *new_cell = module->addCell(inst.map_name(flat_tpl.cell_names[i]), flat_tpl.cells[i]);
+			inst.map_attributes(new_cell, flat_tpl.cell_names[i]);
 			if (new_cell->has_memid()) {
 				IdString memid = new_cell->getParam(ID::MEMID).decode_string();
 				new_cell->setParam(ID::MEMID, Const(memory_map.at(memid).str()));
@@ -151,21 +273,12 @@ struct FlattenWorker
 			map_sigspec(wire_map, new_conn.first);
 			map_sigspec(wire_map, new_conn.second);
 			module->connect(new_conn);
+			sigmap.add(new_conn.first, new_conn.second);
 		}
 
 		// Attach port connections of the flattened cell
 
-		pool<SigBit> tpl_driven;
-		for (auto tpl_cell : tpl->cells())
-			for (auto &tpl_conn : tpl_cell->connections())
-				if (tpl_cell->output(tpl_conn.first))
-					for (auto bit : tpl_conn.second)
-						tpl_driven.insert(bit);
-		for (auto &tpl_conn : tpl->connections())
-			for (auto bit : tpl_conn.first)
-				tpl_driven.insert(bit);
-
-		SigMap sigmap(module);
+		const pool<SigBit> &tpl_driven = flat_tpl.tpl_driven;
 		for (auto &port_it : cell->connections())
 		{
 			IdString port_name = port_it.first;
@@ -218,6 +331,7 @@ struct FlattenWorker
 					log_id(module), log_id(cell), log_id(port_it.first), log_signal(new_conn.first), log_signal(new_conn.second));
 
 			module->connect(new_conn);
+			sigmap.add(new_conn.first, new_conn.second);
 		}
 
 		module->remove(cell);
@@ -228,6 +342,10 @@ struct FlattenWorker
 		if (!design->selected(module) || module->get_blackbox_attribute(ignore_wb))
 			return;
 
+		// The module is about to change, so any instances of it flattened later must not use a stale template.
+		templates.erase(module);
+
+		SigMap sigmap(module);
 		std::vector<RTLIL::Cell*> worklist = module->selected_cells();
 		while (!worklist.empty())
 		{
@@ -251,7 +369,7 @@ struct FlattenWorker
 			// If a design is fully selected and has a top module defined, topological sorting ensures that all cells
 			// added during flattening are black boxes, and flattening is finished in one pass. However, when flattening
 			// individual modules, this isn't the case, and the newly added cells might have to be flattened further.
-			flatten_cell(design, module, cell, tpl, worklist);
+			flatten_cell(design, module, cell, tpl, sigmap, worklist);
 		}
 	}
 };
@@ -26,6 +26,9 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <fstream>
+#include <map>
+#include <memory>
 
 #include "simplemap.h"
 
@@ -47,16 +50,12 @@ void apply_prefix(IdString prefix, IdString &id)
 		id = stringf("$techmap%s.%s", prefix.c_str(), id.c_str());
 }
 
-void apply_prefix(IdString prefix, RTLIL::SigSpec &sig, RTLIL::Module *module)
+void apply_prefix(const dict<RTLIL::Wire*, RTLIL::Wire*> &wire_map, RTLIL::SigSpec &sig)
 {
 	vector<SigChunk> chunks = sig;
 	for (auto &chunk : chunks)
-		if (chunk.wire != nullptr) {
-			IdString wire_name = chunk.wire->name;
-			apply_prefix(prefix, wire_name);
-			log_assert(module->wire(wire_name) != nullptr);
-			chunk.wire = module->wire(wire_name);
-		}
+		if (chunk.wire != nullptr)
+			chunk.wire = wire_map.at(chunk.wire);
 	sig = chunks;
 }
 
@@ -77,12 +76,45 @@ struct TechmapWorker
 
 	typedef dict<IdString, std::vector<TechmapWireData>> TechmapWires;
 
+	// Properties of a template that do not depend on the cell it is instantiated for.
+	struct TechmapTemplateInfo {
+		dict<IdString, IdString> positional_ports;
+		pool<SigBit> tpl_written_bits;
+		bool has_replace_cell = false;
+	};
+
+	dict<RTLIL::Module*, TechmapTemplateInfo> template_info;
+
 	bool extern_mode = false;
 	bool assert_mode = false;
 	bool recursive_mode = false;
 	bool autoproc_mode = false;
 	bool ignore_wb = false;
 
+	const TechmapTemplateInfo &get_template_info(RTLIL::Module *tpl)
+	{
+		auto it = template_info.find(tpl);
+		if (it != template_info.end())
+			return it->second;
+
+		TechmapTemplateInfo &info = template_info[tpl];
+		for (auto tpl_w : tpl->wires())
+			if (tpl_w->port_id > 0)
+				info.positional_ports.emplace(stringf("$%d", tpl_w->port_id), tpl_w->name);
+		for (auto tpl_cell : tpl->cells()) {
+			if (tpl_cell->name.ends_with("_TECHMAP_REPLACE_"))
+				info.has_replace_cell = true;
+			for (auto &conn : tpl_cell->connections())
+				if (tpl_cell->output(conn.first))
+					for (auto bit : conn.second)
+						info.tpl_written_bits.insert(bit);
+		}
+		for (auto &conn : tpl->connections())
+			for (auto bit : conn.first)
+				info.tpl_written_bits.insert(bit);
+		return info;
+	}
+
 	std::string constmap_tpl_name(SigMap &sigmap, RTLIL::Module *tpl, RTLIL::Cell *cell, bool verbose)
 	{
 		std::string constmap_info;
@@ -155,15 +187,14 @@ struct TechmapWorker
 				log_error("Technology map yielded processes -> this is not supported (use -autoproc to run 'proc' automatically).\n");
 		}
 
+		const TechmapTemplateInfo &info = get_template_info(tpl);
+
 		std::string orig_cell_name;
 		pool<string> extra_src_attrs = cell->get_strpool_attribute(ID::src);
 
 		orig_cell_name = cell->name.str();
-		for (auto tpl_cell : tpl->cells())
-			if (tpl_cell->name.ends_with("_TECHMAP_REPLACE_")) {
-				module->rename(cell, stringf("$techmap%d", autoidx++) + cell->name.str());
-				break;
-			}
+		if (info.has_replace_cell)
+			module->rename(cell, stringf("$techmap%d", autoidx++) + cell->name.str());
 
 		dict<IdString, IdString> memory_renames;
 
@@ -177,19 +208,18 @@ struct TechmapWorker
 			design->select(module, m);
 		}
 
-		dict<IdString, IdString> positional_ports;
+		const dict<IdString, IdString> &positional_ports = info.positional_ports;
 		dict<Wire*, IdString> temp_renamed_wires;
+		dict<Wire*, Wire*> wire_map;
 		pool<SigBit> autopurge_tpl_bits;
 
 		for (auto tpl_w : tpl->wires())
 		{
-			if (tpl_w->port_id > 0)
+			if (tpl_w->port_id > 0 && tpl_w->get_bool_attribute(ID::techmap_autopurge))
 			{
 				IdString posportname = stringf("$%d", tpl_w->port_id);
-				positional_ports.emplace(posportname, tpl_w->name);
 
-				if (tpl_w->get_bool_attribute(ID::techmap_autopurge) &&
-						(!cell->hasPort(tpl_w->name) || !GetSize(cell->getPort(tpl_w->name))) &&
+				if ((!cell->hasPort(tpl_w->name) || !GetSize(cell->getPort(tpl_w->name))) &&
 						(!cell->hasPort(posportname) || !GetSize(cell->getPort(posportname))))
 				{
 					if (sigmaps.count(tpl) == 0)
@@ -220,6 +250,7 @@ struct TechmapWorker
 					w->add_strpool_attribute(ID::src, extra_src_attrs);
 			}
 			design->select(module, w);
+			wire_map[tpl_w] = w;
 
 			if (const char *p = strstr(tpl_w->name.c_str(), "_TECHMAP_REPLACE_.")) {
 				IdString replace_name = stringf("%s%s", orig_cell_name.c_str(), p + strlen("_TECHMAP_REPLACE_"));
@@ -228,16 +259,7 @@ struct TechmapWorker
 			}
 		}
 
-		pool<SigBit> tpl_written_bits;
-		for (auto tpl_cell : tpl->cells())
-		for (auto &conn : tpl_cell->connections())
-			if (tpl_cell->output(conn.first))
-				for (auto bit : conn.second)
-					tpl_written_bits.insert(bit);
-		for (auto &conn : tpl->connections())
-			for (auto bit : conn.first)
-				tpl_written_bits.insert(bit);
-
+		const pool<SigBit> &tpl_written_bits = info.tpl_written_bits;
 		SigMap port_signal_map;
 
 		for (auto &it : cell->connections())
@@ -260,18 +282,18 @@ struct TechmapWorker
 			if (w->port_output && !w->port_input) {
 				c.first = it.second;
 				c.second = RTLIL::SigSpec(w);
-				apply_prefix(cell->name, c.second, module);
+				apply_prefix(wire_map, c.second);
 				extra_connect.first = c.second;
 				extra_connect.second = c.first;
 			} else if (!w->port_output && w->port_input) {
 				c.first = RTLIL::SigSpec(w);
 				c.second = it.second;
-				apply_prefix(cell->name, c.first, module);
+				apply_prefix(wire_map, c.first);
 				extra_connect.first = c.first;
 				extra_connect.second = c.second;
 			} else {
 				SigSpec sig_tpl = w, sig_tpl_pf = w, sig_mod = it.second;
-				apply_prefix(cell->name, sig_tpl_pf, module);
+				apply_prefix(wire_map, sig_tpl_pf);
 				for (int i = 0; i < GetSize(sig_tpl) && i < GetSize(sig_mod); i++) {
 					if (tpl_written_bits.count(sig_tpl[i])) {
 						c.first.append(sig_mod[i]);
@@ -355,7 +377,7 @@ struct TechmapWorker
 					autopurge_ports.push_back(conn.first);
 				} else {
 					RTLIL::SigSpec new_conn = conn.second;
-					apply_prefix(cell->name, new_conn, module);
+					apply_prefix(wire_map, new_conn);
 					port_signal_map.apply(new_conn);
 					c->setPort(conn.first, std::move(new_conn));
 				}
@@ -385,8 +407,8 @@ struct TechmapWorker
 
 		for (auto &it : tpl->connections()) {
 			RTLIL::SigSig c = it;
-			apply_prefix(cell->name.str(), c.first, module);
-			apply_prefix(cell->name.str(), c.second, module);
+			apply_prefix(wire_map, c.first);
+			apply_prefix(wire_map, c.second);
 			port_signal_map.apply(c.first);
 			port_signal_map.apply(c.second);
 			module->connect(c);
@@ -971,8 +993,100 @@ struct TechmapWorker
 	}
 };
 
+bool hash_input_file(const std::string &filename, std::string &hash)
+{
+	std::ifstream f(filename, std::ios::binary);
+	if (f.fail())
+		return false;
+	std::string content((std::istreambuf_iterator<char>(f)), std::istreambuf_iterator<char>());
+	hash = sha1(content);
+	return true;
+}
+
+// A parsed map library, together with the template specializations derived from it. The map design is
+// modified as templates are specialized, so an entry is only ever used by one techmap invocation at a time.
+struct TechmapLibrary
+{
+	std::unique_ptr<RTLIL::Design> map;
+	dict<IdString, pool<IdString>> celltypeMap;
+	dict<std::pair<IdString, dict<IdString, RTLIL::Const>>, RTLIL::Module*> techmap_cache;
+	dict<RTLIL::Module*, bool> techmap_do_cache;
+
+	// the files read by the frontends while loading the library, with the hashes of their contents
+	std::vector<std::pair<std::string, std::string>> input_files;
+	int last_used = 0;
+
+	bool record_input_files(const std::set<std::string> &filenames)
+	{
+		for (auto &fn : filenames) {
+			std::string hash;
+			if (!hash_input_file(fn, hash))
+				return false;
+			input_files.push_back(std::make_pair(fn, hash));
+		}
+		return true;
+	}
+
+	bool input_files_unchanged() const
+	{
+		for (auto &it : input_files) {
+			std::string hash;
+			if (!hash_input_file(it.first, hash) || hash != it.second)
+				return false;
+		}
+		return true;
+	}
+
+	void build_celltype_map()
+	{
+		for (auto module : map->modules()) {
+			if (module->attributes.count(ID::techmap_celltype) && !module->attributes.at(ID::techmap_celltype).bits.empty()) {
+				char *p = strdup(module->attributes.at(ID::techmap_celltype).decode_string().c_str());
+				for (char *q = strtok(p, " \t\r\n"); q; q = strtok(nullptr, " \t\r\n")) {
+					std::vector<std::string> queue;
+					queue.push_back(q);
+					while (!queue.empty()) {
+						std::string name = queue.back();
+						queue.pop_back();
+						auto pos = name.find('[');
+						if (pos == std::string::npos) {
+							// No further expansion.
+							celltypeMap[RTLIL::escape_id(name)].insert(module->name);
+						} else {
+							// Expand [] in this name.
+							auto epos = name.find(']', pos);
+							if (epos == std::string::npos)
+								log_error("Malformed techmap_celltype pattern %s\n", q);
+							for (size_t i = pos + 1; i < epos; i++) {
+								queue.push_back(name.substr(0, pos) + name[i] + name.substr(epos + 1, std::string::npos));
+							}
+						}
+					}
+				}
+				free(p);
+			} else {
+				IdString module_name = module->name.begins_with("\\$") ?
+						module->name.substr(1) : module->name.str();
+				celltypeMap[module_name].insert(module->name);
+			}
+		}
+	}
+};
+
+// Parsed map libraries are kept across techmap invocations, keyed by the names of the map files and the
+// options that affect how the library is loaded and how its templates are specialized. A cached library is
+// only used again while all files that were read to load it (including `include files) are unchanged. The
+// least recently used libraries are dropped when there are more than techmap_libraries_limit of them.
+std::map<std::string, TechmapLibrary> techmap_libraries;
+const int techmap_libraries_limit = 8;
+int techmap_libraries_stamp = 0;
+
 struct TechmapPass : public Pass {
 	TechmapPass() : Pass("techmap", "generic technology mapper") { }
+	void on_shutdown() override
+	{
+		techmap_libraries.clear();
+	}
 	void help() override
 	{
 		//   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
@@ -1021,6 +1135,14 @@ struct TechmapPass : public Pass {
 		log("        map file. Note that the Verilog frontend is also called with the\n");
 		log("        '-nooverwrite' option set.\n");
 		log("\n");
+		log("    -nocache\n");
+		log("        do not reuse a map library loaded by an earlier techmap invocation.\n");
+		log("        by default, map libraries loaded from files are kept in memory,\n");
+		log("        together with all template specializations derived from them, and\n");
+		log("        are used again as long as the options and the contents of all files\n");
+		log("        read to load them are unchanged. up to 8 libraries are kept, the least\n");
+		log("        recently used ones are freed first.\n");
+		log("\n");
 		log("When a module in the map file has the 'techmap_celltype' attribute set, it will\n");
 		log("match cells with a type that match the text value of this attribute. Otherwise\n");
 		log("the module name will be used to match the cell.  Multiple space-separated cell\n");
@@ -1150,6 +1272,7 @@ struct TechmapPass : public Pass {
 		std::vector<std::string> map_files;
 		std::string verilog_frontend = "verilog -nooverwrite -noblackbox";
 		int max_iter = -1;
+		bool nocache = false;
 
 		size_t argidx;
 		for (argidx = 1; argidx < args.size(); argidx++) {
@@ -1169,6 +1292,10 @@ struct TechmapPass : public Pass {
 				verilog_frontend += " -I " + args[++argidx];
 				continue;
 			}
+			if (args[argidx] == "-nocache") {
+				nocache = true;
+				continue;
+			}
 			if (args[argidx] == "-assert") {
 				worker.assert_mode = true;
 				continue;
@@ -1193,58 +1320,67 @@ struct TechmapPass : public Pass {
 		}
 		extra_args(args, argidx, design);
 
-		RTLIL::Design *map = new RTLIL::Design;
-		if (map_files.empty()) {
-			Frontend::frontend_call(map, nullptr, "+/techmap.v", verilog_frontend);
+		if (map_files.empty())
+			map_files.push_back("+/techmap.v");
+
+		std::string cache_key;
+		bool use_cache = !nocache;
+		if (use_cache) {
+			std::string key_data = stringf("%s|%d|%d", verilog_frontend.c_str(), worker.recursive_mode, worker.autoproc_mode);
+			for (auto &fn : map_files) {
+				if (fn.compare(0, 1, "%") == 0)
+					use_cache = false;
+				key_data += "|" + fn;
+			}
+			cache_key = sha1(key_data);
+		}
+
+		// Take the library out of the cache while it is in use, so that an error in the middle of
+		// mapping does not leave a half-specialized library behind.
+		TechmapLibrary library;
+		auto cached = use_cache ? techmap_libraries.find(cache_key) : techmap_libraries.end();
+		if (cached != techmap_libraries.end() && cached->second.input_files_unchanged()) {
+			library = std::move(cached->second);
+			techmap_libraries.erase(cached);
+			log("Using cached map library (%d modules).\n", GetSize(library.map->modules()));
 		} else {
-			for (auto &fn : map_files)
-				if (fn.compare(0, 1, "%") == 0) {
-					if (!saved_designs.count(fn.substr(1))) {
-						delete map;
-						log_cmd_error("Can't open saved design `%s'.\n", fn.c_str()+1);
+			if (cached != techmap_libraries.end())
+				techmap_libraries.erase(cached);
+
+			// Collect the files opened by the frontends, to check whether the library can be used again later.
+			std::set<std::string> saved_input_files;
+			saved_input_files.swap(yosys_input_files);
+
+			library.map.reset(new RTLIL::Design);
+			try {
+				for (auto &fn : map_files)
+					if (fn.compare(0, 1, "%") == 0) {
+						if (!saved_designs.count(fn.substr(1)))
+							log_cmd_error("Can't open saved design `%s'.\n", fn.c_str()+1);
+						for (auto mod : saved_designs.at(fn.substr(1))->modules())
+							if (!library.map->module(mod->name))
+								library.map->add(mod->clone());
+					} else {
+						Frontend::frontend_call(library.map.get(), nullptr, fn, (fn.size() > 3 && fn.compare(fn.size()-3, std::string::npos, ".il") == 0 ? "rtlil" : verilog_frontend));
 					}
-					for (auto mod : saved_designs.at(fn.substr(1))->modules())
-						if (!map->module(mod->name))
-							map->add(mod->clone());
-				} else {
-					Frontend::frontend_call(map, nullptr, fn, (fn.size() > 3 && fn.compare(fn.size()-3, std::string::npos, ".il") == 0 ? "rtlil" : verilog_frontend));
-				}
+			} catch (...) {
+				yosys_input_files.insert(saved_input_files.begin(), saved_input_files.end());
+				throw;
+			}
+			library.build_celltype_map();
+
+			if (use_cache && !library.record_input_files(yosys_input_files))
+				use_cache = false;
+			yosys_input_files.insert(saved_input_files.begin(), saved_input_files.end());
 		}
 
 		log_header(design, "Continuing TECHMAP pass.\n");
 
-		dict<IdString, pool<IdString>> celltypeMap;
-		for (auto module : map->modules()) {
-			if (module->attributes.count(ID::techmap_celltype) && !module->attributes.at(ID::techmap_celltype).bits.empty()) {
-				char *p = strdup(module->attributes.at(ID::techmap_celltype).decode_string().c_str());
-				for (char *q = strtok(p, " \t\r\n"); q; q = strtok(nullptr, " \t\r\n")) {
-					std::vector<std::string> queue;
-					queue.push_back(q);
-					while (!queue.empty()) {
-						std::string name = queue.back();
-						queue.pop_back();
-						auto pos = name.find('[');
-						if (pos == std::string::npos) {
-							// No further expansion.
-							celltypeMap[RTLIL::escape_id(name)].insert(module->name);
-						} else {
-							// Expand [] in this name.
-							auto epos = name.find(']', pos);
-							if (epos == std::string::npos)
-								log_error("Malformed techmap_celltype pattern %s\n", q);
-							for (size_t i = pos + 1; i < epos; i++) {
-								queue.push_back(name.substr(0, pos) + name[i] + name.substr(epos + 1, std::string::npos));
-							}
-						}
-					}
-				}
-				free(p);
-			} else {
-				IdString module_name = module->name.begins_with("\\$") ?
-						module->name.substr(1) : module->name.str();
-				celltypeMap[module_name].insert(module->name);
-			}
-		}
+		RTLIL::Design *map = library.map.get();
+		dict<IdString, pool<IdString>> &celltypeMap = library.celltypeMap;
+		worker.techmap_cache.swap(library.techmap_cache);
+		worker.techmap_do_cache.swap(library.techmap_do_cache);
+
 		log_debug("Cell type mappings to use:\n");
 		for (auto &i : celltypeMap) {
 			i.second.sort(RTLIL::sort_by_id_str());
@@ -1278,7 +1414,20 @@ struct TechmapPass : public Pass {
 		}
 
 		log("No more expansions possible.\n");
-		delete map;
+
+		if (use_cache) {
+			worker.techmap_cache.swap(library.techmap_cache);
+			worker.techmap_do_cache.swap(library.techmap_do_cache);
+			library.last_used = ++techmap_libraries_stamp;
+			techmap_libraries[cache_key] = std::move(library);
+			while (GetSize(techmap_libraries) > techmap_libraries_limit) {
+				auto oldest = techmap_libraries.begin();
+				for (auto it = techmap_libraries.begin(); it != techmap_libraries.end(); ++it)
+					if (it->second.last_used < oldest->second.last_used)
+						oldest = it;
+				techmap_libraries.erase(oldest);
+			}
+		}
 
 		log_pop();
 	}
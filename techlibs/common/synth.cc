@@ -48,6 +48,11 @@ struct SynthPass : public ScriptPass
 		log("        flatten the design before synthesis. this will pass '-auto-top' to\n");
 		log("        'hierarchy' if no top module is specified.\n");
 		log("\n");
+		log("    -dedup\n");
+		log("        merge structurally identical modules (see 'help dedup') before coarse\n");
+		log("        optimization, so that each unique module is only synthesized once.\n");
+		log("        run 'dedup -undo' afterwards to restore the original hierarchy.\n");
+		log("\n");
 		log("    -encfile <file>\n");
 		log("        passed to 'fsm_recode' via 'fsm'\n");
 		log("\n");
@@ -88,7 +93,7 @@ struct SynthPass : public ScriptPass
 	}
 
 	string top_module, fsm_opts, memory_opts, abc;
-	bool autotop, flatten, noalumacc, nofsm, noabc, noshare, flowmap;
+	bool autotop, flatten, dedup, noalumacc, nofsm, noabc, noshare, flowmap;
 	int lut;
 
 	void clear_flags() override
@@ -99,6 +104,7 @@ struct SynthPass : public ScriptPass
 
 		autotop = false;
 		flatten = false;
+		dedup = false;
 		lut = 0;
 		noalumacc = false;
 		nofsm = false;
@@ -143,6 +149,10 @@ struct SynthPass : public ScriptPass
 				flatten = true;
 				continue;
 			}
+			if (args[argidx] == "-dedup") {
+				dedup = true;
+				continue;
+			}
 			if (args[argidx] == "-lut") {
 				lut = atoi(args[++argidx].c_str());
 				continue;
@@ -219,6 +229,8 @@ struct SynthPass : public ScriptPass
 				run("flatten", "  (if -flatten)");
 			run("opt_expr");
 			run("opt_clean");
+			if (help_mode || dedup)
+				run("dedup", "    (if -dedup)");
 			run("check");
 			run("opt -nodffe -nosdff");
 			if (!nofsm)
@@ -0,0 +1,13 @@
+#!/bin/bash
+set -ex
+../../yosys -q -p "read_verilog cxxrtl_activity.v; write_cxxrtl -noflatten -header -namespace all cxxrtl_activity_all.cc"
+../../yosys -q -p "read_verilog cxxrtl_activity.v; write_cxxrtl -noflatten -header -namespace act -activity cxxrtl_activity_act.cc"
+../../yosys -q -p "read_verilog cxxrtl_activity.v; write_cxxrtl -noflatten -noproc -header -namespace noproc_all cxxrtl_activity_noproc_all.cc"
+../../yosys -q -p "read_verilog cxxrtl_activity.v; write_cxxrtl -noflatten -noproc -header -namespace noproc_act -activity cxxrtl_activity_noproc_act.cc"
+grep -q "activity_" cxxrtl_activity_act.cc
+grep -q "activity_" cxxrtl_activity_noproc_act.cc
+${CXX:-c++} -std=c++14 -O1 -I../.. -o cxxrtl_activity cxxrtl_activity_tb.cc cxxrtl_activity_all.cc cxxrtl_activity_act.cc \
+	cxxrtl_activity_noproc_all.cc cxxrtl_activity_noproc_act.cc
+./cxxrtl_activity | grep -q PASS
+rm -f cxxrtl_activity cxxrtl_activity_all.cc cxxrtl_activity_all.h cxxrtl_activity_act.cc cxxrtl_activity_act.h \
+	cxxrtl_activity_noproc_all.cc cxxrtl_activity_noproc_all.h cxxrtl_activity_noproc_act.cc cxxrtl_activity_noproc_act.h
@@ -0,0 +1,36 @@
+module sub(input clk, input en, input [7:0] d, output reg [7:0] q, output [7:0] y);
+always @(posedge clk)
+	if (en)
+		q <= q + d;
+assign y = q ^ d;
+endmodule
+
+module top(input clk, input clk2, input en, input we, input [3:0] waddr, raddr, input [7:0] a, b,
+		output reg [7:0] r0, output reg [7:0] r1, output [7:0] c0, output [7:0] m0, output [7:0] s0, output [7:0] s1,
+		output reg [7:0] cnt);
+
+// registers that only change when enabled, or when their (second) clock ticks
+always @(posedge clk)
+	if (en)
+		r0 <= r0 + a;
+always @(posedge clk2)
+	r1 <= r1 ^ b;
+
+// a register that changes on every clock edge while its other inputs are constant
+always @(posedge clk)
+	cnt <= cnt + 8'd1;
+
+// a combinational path from inputs that change rarely
+assign c0 = a + b;
+
+// a writable memory with an asynchronous read port
+reg [7:0] mem [0:15];
+always @(posedge clk)
+	if (we)
+		mem[waddr] <= a;
+assign m0 = mem[raddr];
+
+// an instance of another module
+sub u_sub(.clk(clk), .en(we), .d(b), .q(s0), .y(s1));
+
+endmodule
@@ -0,0 +1,6 @@
+#!/bin/bash
+set -ex
+../../yosys -q -p "read_verilog cxxrtl_async_vcd.v; write_cxxrtl -header cxxrtl_async_vcd_top.cc"
+${CXX:-c++} -std=c++14 -O1 -I../.. -pthread -o cxxrtl_async_vcd cxxrtl_async_vcd_tb.cc cxxrtl_async_vcd_top.cc
+./cxxrtl_async_vcd | grep -q PASS
+rm -f cxxrtl_async_vcd cxxrtl_async_vcd_top.cc cxxrtl_async_vcd_top.h
@@ -0,0 +1,11 @@
+module top(input clk, input we, input [3:0] addr, input [39:0] d, output reg [39:0] q, output reg p);
+
+reg [39:0] mem [0:15];
+always @(posedge clk) begin
+	if (we)
+		mem[addr] <= d;
+	q <= mem[addr];
+	p <= ^d;
+end
+
+endmodule
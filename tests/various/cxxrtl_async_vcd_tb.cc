@@ -0,0 +1,61 @@
+#include <cstdio>
+#include <sstream>
+#define CXXRTL_THREADS
+#include <backends/cxxrtl/cxxrtl_vcd.h>
+#include "cxxrtl_async_vcd_top.h"
+
+int main()
+{
+	cxxrtl_design::p_top sync_top, async_top;
+	cxxrtl::debug_items sync_items, async_items;
+	sync_top.debug_info(sync_items);
+	async_top.debug_info(async_items);
+
+	std::string sync_output;
+	std::ostringstream async_output;
+	{
+		cxxrtl::vcd_writer sync_vcd;
+		// a small batch size, so that many batches are handed over to the background thread
+		cxxrtl::async_vcd_writer async_vcd(async_output, /*batch_size=*/64);
+		sync_vcd.timescale(1, "us");
+		async_vcd.timescale(1, "us");
+		sync_vcd.add(sync_items);
+		async_vcd.add(async_items);
+
+		uint32_t state = 1;
+		for (int cycle = 0; cycle < 2000; cycle++) {
+			state ^= state << 13;
+			state ^= state >> 17;
+			state ^= state << 5;
+			for (auto top : { &sync_top, &async_top }) {
+				top->p_clk.set<bool>(cycle & 1);
+				top->p_we.set<bool>(state & 1);
+				top->p_addr.set<uint8_t>((state >> 1) & 0xf);
+				top->p_d.set<uint64_t>((uint64_t(state) << 8) ^ cycle);
+				top->step();
+			}
+			sync_vcd.sample(cycle);
+			async_vcd.sample(cycle);
+			sync_output += sync_vcd.buffer;
+			sync_vcd.buffer.clear();
+		}
+		async_vcd.flush();
+		if (async_output.str() != sync_output) {
+			fprintf(stderr, "Output differs before the writer is destroyed.\n");
+			return 1;
+		}
+
+		for (int cycle = 2000; cycle < 2010; cycle++) {
+			sync_vcd.sample(cycle);
+			async_vcd.sample(cycle);
+		}
+		sync_output += sync_vcd.buffer;
+	}
+	if (async_output.str() != sync_output) {
+		fprintf(stderr, "Output differs after the writer is destroyed.\n");
+		return 1;
+	}
+
+	printf("PASS\n");
+	return 0;
+}
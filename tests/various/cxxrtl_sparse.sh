@@ -0,0 +1,10 @@
+#!/bin/bash
+set -ex
+../../yosys -q -p "read_verilog cxxrtl_sparse.v; write_cxxrtl -header cxxrtl_sparse_top.cc"
+grep -q "sparse_memory<8> memory_p_mem" cxxrtl_sparse_top.h
+if ../../yosys -q -p "read_verilog cxxrtl_sparse.v; write_cxxrtl -sparse-depth -1 cxxrtl_sparse_top.cc"; then
+	exit 1
+fi
+${CXX:-c++} -std=c++14 -O1 -I../.. -o cxxrtl_sparse cxxrtl_sparse_tb.cc cxxrtl_sparse_top.cc
+./cxxrtl_sparse | grep -q PASS
+rm -f cxxrtl_sparse cxxrtl_sparse_top.cc cxxrtl_sparse_top.h
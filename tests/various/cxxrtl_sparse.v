@@ -0,0 +1,11 @@
+module top(input clk, input we, input [15:0] waddr, raddr, input [7:0] wdata, output [7:0] rdata);
+
+(* cxxrtl_sparse *)
+reg [7:0] mem [0:65535];
+initial mem[100] = 8'h5a;
+always @(posedge clk)
+	if (we)
+		mem[waddr] <= wdata;
+assign rdata = mem[raddr];
+
+endmodule
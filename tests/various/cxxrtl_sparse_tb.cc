@@ -0,0 +1,71 @@
+#include <cstdio>
+#include <map>
+#include "cxxrtl_sparse_top.h"
+
+static int failures = 0;
+
+static void check_read(cxxrtl_design::p_top &top, uint16_t addr, uint8_t expected)
+{
+	top.p_raddr.set<uint16_t>(addr);
+	top.step();
+	if (top.p_rdata.get<uint8_t>() != expected) {
+		fprintf(stderr, "Read %02x from address %u, expected %02x.\n", top.p_rdata.get<uint8_t>(), addr, expected);
+		failures++;
+	}
+}
+
+static void write(cxxrtl_design::p_top &top, uint16_t addr, uint8_t data)
+{
+	top.p_we.set<bool>(true);
+	top.p_waddr.set<uint16_t>(addr);
+	top.p_wdata.set<uint8_t>(data);
+	top.p_clk.set<bool>(false);
+	top.step();
+	top.p_clk.set<bool>(true);
+	top.step();
+	top.p_we.set<bool>(false);
+	top.p_clk.set<bool>(false);
+	top.step();
+}
+
+int main()
+{
+	cxxrtl_design::p_top top;
+
+	// only the page with the initialized word is allocated
+	if (top.memory_p_mem.allocated_pages() != 1) {
+		fprintf(stderr, "%zu pages allocated before any writes.\n", top.memory_p_mem.allocated_pages());
+		failures++;
+	}
+
+	// unwritten words read as zero, both in the initialized page and in unallocated pages
+	check_read(top, 100, 0x5a);
+	check_read(top, 101, 0x00);
+	check_read(top, 5000, 0x00);
+	check_read(top, 65535, 0x00);
+
+	std::map<uint16_t, uint8_t> written = {
+		{ 101, 0x11 }, { 4095, 0x22 }, { 4096, 0x33 }, { 40000, 0x44 }, { 65535, 0x55 },
+	};
+	for (auto &it : written)
+		write(top, it.first, it.second);
+
+	for (auto &it : written)
+		check_read(top, it.first, it.second);
+	check_read(top, 100, 0x5a);
+	check_read(top, 4094, 0x00);
+	check_read(top, 4097, 0x00);
+	check_read(top, 40001, 0x00);
+	check_read(top, 20000, 0x00);
+
+	// pages 0, 1, 9 and 15 are allocated
+	if (top.memory_p_mem.allocated_pages() != 4) {
+		fprintf(stderr, "%zu pages allocated after writes.\n", top.memory_p_mem.allocated_pages());
+		failures++;
+	}
+
+	if (failures)
+		return 1;
+	printf("PASS\n");
+	return 0;
+}
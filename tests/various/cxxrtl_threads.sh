@@ -0,0 +1,16 @@
+#!/bin/bash
+set -ex
+../../yosys -q -p "read_verilog cxxrtl_threads.v; write_cxxrtl -header -namespace st cxxrtl_threads_st.cc"
+../../yosys -q -p "read_verilog cxxrtl_threads.v; write_cxxrtl -header -namespace mt -threads 2 cxxrtl_threads_mt.cc"
+grep -q "thread_pool::shared().run(2," cxxrtl_threads_mt.cc
+if grep -q "CXXRTL_THREADS" cxxrtl_threads_st.h; then
+	exit 1
+fi
+printf '#include "cxxrtl_threads_st.h"\n#include "cxxrtl_threads_mt.h"\n' > cxxrtl_threads_order.cc
+if ${CXX:-c++} -std=c++14 -I../.. -fsyntax-only cxxrtl_threads_order.cc 2> cxxrtl_threads_order.log; then
+	exit 1
+fi
+grep -q "require CXXRTL_THREADS to be defined" cxxrtl_threads_order.log
+${CXX:-c++} -std=c++14 -O1 -I../.. -pthread -o cxxrtl_threads cxxrtl_threads_tb.cc cxxrtl_threads_st.cc cxxrtl_threads_mt.cc
+./cxxrtl_threads | grep -q PASS
+rm -f cxxrtl_threads cxxrtl_threads_order.cc cxxrtl_threads_order.log cxxrtl_threads_st.cc cxxrtl_threads_st.h cxxrtl_threads_mt.cc cxxrtl_threads_mt.h
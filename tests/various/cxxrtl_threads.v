@@ -0,0 +1,17 @@
+module top(input clk, input [31:0] a, b, output reg [31:0] y0, output reg [31:0] y1, output [31:0] y2);
+
+reg [31:0] lfsr = 32'h1;
+always @(posedge clk) begin
+	lfsr <= {lfsr[30:0], lfsr[31] ^ lfsr[21] ^ lfsr[1] ^ lfsr[0]};
+	y0 <= y0 + (lfsr ^ a);
+end
+
+reg [31:0] prod = 0;
+always @(posedge clk) begin
+	prod <= b * (b >> 3);
+	y1 <= y1 - prod;
+end
+
+assign y2 = a ^ {b[15:0], b[31:16]};
+
+endmodule
@@ -0,0 +1,37 @@
+#include <cstdio>
+// the threaded model comes first, as it enables the thread pool in the CXXRTL runtime
+#include "cxxrtl_threads_mt.h"
+#include "cxxrtl_threads_st.h"
+
+int main()
+{
+	cxxrtl::thread_pool::shared().resize(1);
+
+	st::p_top st_top;
+	mt::p_top mt_top;
+
+	uint32_t state = 1;
+	for (int cycle = 0; cycle < 2000; cycle++) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		st_top.p_a.set<uint32_t>(state);
+		mt_top.p_a.set<uint32_t>(state);
+		st_top.p_b.set<uint32_t>(state * 2654435761u);
+		mt_top.p_b.set<uint32_t>(state * 2654435761u);
+		st_top.p_clk.set<bool>(cycle & 1);
+		mt_top.p_clk.set<bool>(cycle & 1);
+		st_top.step();
+		mt_top.step();
+
+		if (st_top.p_y0.get<uint32_t>() != mt_top.p_y0.get<uint32_t>() ||
+				st_top.p_y1.get<uint32_t>() != mt_top.p_y1.get<uint32_t>() ||
+				st_top.p_y2.get<uint32_t>() != mt_top.p_y2.get<uint32_t>()) {
+			fprintf(stderr, "Mismatch in cycle %d.\n", cycle);
+			return 1;
+		}
+	}
+
+	printf("PASS\n");
+	return 0;
+}
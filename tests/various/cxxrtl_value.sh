@@ -0,0 +1,7 @@
+#!/bin/bash
+set -ex
+for wide_limbs in 0 1; do
+	${CXX:-c++} -std=c++14 -O1 -I../.. -DCXXRTL_WIDE_LIMBS=$wide_limbs -o cxxrtl_value cxxrtl_value_tb.cc
+	./cxxrtl_value | grep -q PASS
+done
+rm -f cxxrtl_value
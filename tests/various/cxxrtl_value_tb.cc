@@ -0,0 +1,226 @@
+#include <cstdio>
+#include <cstdint>
+#include <vector>
+#include <backends/cxxrtl/cxxrtl.h>
+
+using cxxrtl::value;
+
+// Reference model: values as vectors of bits, least significant bit first.
+typedef std::vector<bool> bits_t;
+
+static int failures = 0;
+
+static uint64_t rng_state = 0x9e3779b97f4a7c15;
+
+static uint64_t rng()
+{
+	// xorshift64, seeded with a constant so that failures are reproducible.
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 7;
+	rng_state ^= rng_state << 17;
+	return rng_state;
+}
+
+template<size_t Bits>
+static bits_t to_bits(const value<Bits> &v)
+{
+	bits_t result(Bits);
+	for (size_t n = 0; n < Bits; n++)
+		result[n] = (v.data[n / 32] >> (n % 32)) & 1;
+	return result;
+}
+
+template<size_t Bits>
+static value<Bits> from_bits(const bits_t &b)
+{
+	value<Bits> result;
+	for (size_t n = 0; n < Bits; n++)
+		if (b[n])
+			result.data[n / 32] |= uint32_t(1) << (n % 32);
+	return result;
+}
+
+static bits_t ref_resize(const bits_t &a, size_t width)
+{
+	bits_t result(a);
+	result.resize(width, false);
+	return result;
+}
+
+static bits_t ref_add(const bits_t &a, const bits_t &b, bool carry = false)
+{
+	bits_t result(a.size());
+	for (size_t n = 0; n < a.size(); n++) {
+		result[n] = a[n] ^ b[n] ^ carry;
+		carry = (a[n] && b[n]) || (a[n] && carry) || (b[n] && carry);
+	}
+	return result;
+}
+
+static bits_t ref_not(const bits_t &a)
+{
+	bits_t result(a.size());
+	for (size_t n = 0; n < a.size(); n++)
+		result[n] = !a[n];
+	return result;
+}
+
+static bits_t ref_sub(const bits_t &a, const bits_t &b)
+{
+	return ref_add(a, ref_not(b), true);
+}
+
+static bits_t ref_mul(const bits_t &a, const bits_t &b, size_t width)
+{
+	bits_t result(width), addend = ref_resize(a, width);
+	for (size_t n = 0; n < b.size() && n < width; n++) {
+		if (b[n])
+			result = ref_add(result, addend);
+		addend.insert(addend.begin(), false);
+		addend.pop_back();
+	}
+	return result;
+}
+
+static bits_t ref_shl(const bits_t &a, size_t amount)
+{
+	bits_t result(a.size());
+	for (size_t n = amount; n < a.size(); n++)
+		result[n] = a[n - amount];
+	return result;
+}
+
+static bits_t ref_shr(const bits_t &a, size_t amount, bool sign)
+{
+	bits_t result(a.size(), sign && a.back());
+	for (size_t n = 0; n + amount < a.size(); n++)
+		result[n] = a[n + amount];
+	return result;
+}
+
+static bool ref_ult(const bits_t &a, const bits_t &b)
+{
+	for (size_t n = a.size(); n-- > 0;)
+		if (a[n] != b[n])
+			return b[n];
+	return false;
+}
+
+static bool ref_slt(const bits_t &a, const bits_t &b)
+{
+	if (a.back() != b.back())
+		return a.back();
+	return ref_ult(a, b);
+}
+
+static size_t ref_ctpop(const bits_t &a)
+{
+	size_t count = 0;
+	for (bool bit : a)
+		count += bit;
+	return count;
+}
+
+// Random values biased towards the patterns that exercise carries across chunk and limb boundaries.
+template<size_t Bits>
+static value<Bits> random_value()
+{
+	bits_t result(Bits);
+	switch (rng() % 8) {
+		case 0: // all zeroes
+			break;
+		case 1: // all ones
+			result.assign(Bits, true);
+			break;
+		case 2: // single bit set
+			result[rng() % Bits] = true;
+			break;
+		case 3: // ones below a boundary
+			for (size_t n = 0; n < Bits && n < 32 * (1 + rng() % 7); n++)
+				result[n] = true;
+			break;
+		case 4: // all ones except a single bit
+			result.assign(Bits, true);
+			result[rng() % Bits] = false;
+			break;
+		default:
+			for (size_t n = 0; n < Bits; n++)
+				result[n] = rng() & 1;
+			break;
+	}
+	return from_bits<Bits>(result);
+}
+
+// Compares all chunks, so that bits set above the most significant bit of the result are also caught.
+template<size_t Bits, size_t ResultBits>
+static void check(const char *op, const value<Bits> &a, const value<Bits> &b, const value<ResultBits> &actual, const bits_t &expected)
+{
+	if (actual == from_bits<ResultBits>(expected))
+		return;
+	if (failures++ < 10) {
+		fprintf(stderr, "value<%zu>::%s mismatch; operands:", Bits, op);
+		for (size_t n = 0; n < a.chunks; n++)
+			fprintf(stderr, " %08x", a.data[a.chunks - 1 - n]);
+		fprintf(stderr, " and");
+		for (size_t n = 0; n < b.chunks; n++)
+			fprintf(stderr, " %08x", b.data[b.chunks - 1 - n]);
+		fprintf(stderr, "\n");
+	}
+}
+
+static void check(const char *op, size_t bits, bool actual, bool expected)
+{
+	if (actual != expected && failures++ < 10)
+		fprintf(stderr, "value<%zu>::%s mismatch.\n", bits, op);
+}
+
+template<size_t Bits>
+static void test_width(size_t iterations)
+{
+	for (size_t i = 0; i < iterations; i++) {
+		value<Bits> a = random_value<Bits>(), b = random_value<Bits>();
+		bits_t ra = to_bits(a), rb = to_bits(b);
+
+		check("add", a, b, a.add(b), ref_add(ra, rb));
+		check("sub", a, b, a.sub(b), ref_sub(ra, rb));
+		check("neg", a, b, a.neg(), ref_sub(bits_t(Bits), ra));
+		check("mul", a, b, a.template mul<Bits>(b), ref_mul(ra, rb, Bits));
+		check("mul", a, b, a.template mul<2 * Bits>(b), ref_mul(ra, rb, 2 * Bits));
+		check("mul", a, b, a.template mul<(Bits + 1) / 2>(b), ref_mul(ra, rb, (Bits + 1) / 2));
+		check("ucmp", Bits, a.ucmp(b), ref_ult(ra, rb));
+		check("scmp", Bits, a.scmp(b), ref_slt(ra, rb));
+		check("ucmp", Bits, a.ucmp(a), false);
+		check("scmp", Bits, a.scmp(a), false);
+		check("eq", Bits, a == b, ra == rb);
+		check("ctpop", Bits, a.ctpop() == ref_ctpop(ra), true);
+
+		size_t amount = rng() % (Bits + 8);
+		value<32> amount32 { uint32_t(amount) };
+		check("shl", a, a, a.shl(amount32), ref_shl(ra, amount));
+		check("shr", a, a, a.shr(amount32), ref_shr(ra, amount, false));
+		check("sshr", a, a, a.sshr(amount32), ref_shr(ra, amount, true));
+		// Amounts with any bit set above the least significant chunk shift everything out.
+		value<64> amount64 { uint32_t(amount), 1u };
+		check("shl", a, a, a.shl(amount64), bits_t(Bits));
+		check("shr", a, a, a.shr(amount64), bits_t(Bits));
+		check("sshr", a, a, a.sshr(amount64), bits_t(Bits, a.is_neg()));
+	}
+}
+
+int main()
+{
+	test_width<1>(1000);
+	test_width<31>(1000);
+	test_width<32>(1000);
+	test_width<33>(1000);
+	test_width<63>(1000);
+	test_width<64>(1000);
+	test_width<65>(1000);
+	test_width<128>(1000);
+	test_width<200>(1000);
+
+	if (failures)
+		return 1;
+	printf("PASS\n");
+	return 0;
+}